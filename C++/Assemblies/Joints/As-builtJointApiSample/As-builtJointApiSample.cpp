@@ -7,6 +7,7 @@
 #include <Core/Application/Camera.h>
 #include <Core/Geometry/Point3D.h>
 #include <Core/Geometry/Matrix3D.h>
+#include <Core/Geometry/Vector3D.h>
 #include <Core/UserInterface/UserInterface.h>
 #include <Fusion/Fusion/Design.h>
 #include <Fusion/BRep/BRepFace.h>
@@ -18,6 +19,7 @@
 #include <Fusion/Components/AsBuiltJoints.h>
 #include <Fusion/Components/AsBuiltJointInput.h>
 #include <Fusion/Components/AsBuiltJoint.h>
+#include <Fusion/Components/JointGeometry.h>
 #include <Fusion/Components/Occurrence.h>
 #include <Fusion/Components/Occurrences.h>
 #include <Fusion/Features/Features.h>
@@ -34,12 +36,45 @@
 #include <Fusion/Sketch/SketchPoint.h>
 #include <Fusion/Sketch/SketchPoints.h>
 
+#include <chrono>
+#include <sstream>
+#include <string>
+#include <vector>
+
 using namespace adsk::core;
 using namespace adsk::fusion;
 
 
 Ptr<UserInterface> ui;
 
+// Adds an as-built revolute joint between occurrenceOne and each of the occurrences,
+// all sharing the same joint geometry, and returns the number of joints created. The
+// inputs are prepared before the first joint is added, so the joints are then added
+// back to back. JointApiSample builds joints of any type from a table and caches
+// their geometries per entity.
+size_t addAsBuiltRevoluteJoints(const Ptr<AsBuiltJoints>& asBuiltJoints, const Ptr<Occurrence>& occurrenceOne,
+ const std::vector< Ptr<Occurrence> >& occurrences, const Ptr<JointGeometry>& geometry)
+{
+ if (!asBuiltJoints || !geometry)
+  return 0;
+
+ std::vector< Ptr<AsBuiltJointInput> > inputs;
+ for (const Ptr<Occurrence>& occurrence : occurrences)
+ {
+  Ptr<AsBuiltJointInput> input = asBuiltJoints->createInput(occurrenceOne, occurrence, geometry);
+  if (input && input->setAsRevoluteJointMotion(JointDirections::ZAxisJointDirection, geometry))
+   inputs.push_back(input);
+ }
+
+ size_t createdCount = 0;
+ for (const Ptr<AsBuiltJointInput>& input : inputs)
+ {
+  if (asBuiltJoints->add(input))
+   ++createdCount;
+ }
+ return createdCount;
+}
+
 extern "C" XI_EXPORT bool run(const char* context)
 {
  Ptr<Application> app = Application::get();
@@ -229,6 +264,38 @@ extern "C" XI_EXPORT bool run(const char* context)
  if(!asBuiltJoint)
   return false;
 
+ // Add a row of copies of the pin of sub component 2, 1.5 cm apart along X so that
+ // they do not overlap, and join each of them to sub component 1 with an as-built
+ // revolute joint on the end face of sub component 1
+ const size_t pinCount = 50;
+ std::vector< Ptr<Occurrence> > pinOccs;
+ for (size_t i = 0; i < pinCount; ++i)
+ {
+  Ptr<Matrix3D> pinTransform = adsk::core::Matrix3D::create();
+  if(!pinTransform)
+   return false;
+  pinTransform->translation(adsk::core::Vector3D::create(1.5 * (i + 1), 0.0, 0.0));
+  Ptr<Occurrence> pinOcc = occs->addExistingComponent(subComp1, pinTransform);
+  if(!pinOcc)
+   return false;
+  pinOccs.push_back(pinOcc);
+ }
+ Ptr<BRepFace> endFaceProxy = endFace->createForAssemblyContext(subOcc0);
+ if(!endFaceProxy)
+  return false;
+ Ptr<JointGeometry> pinGeometry = JointGeometry::createByPlanarFace(endFaceProxy, nullptr, JointKeyPointTypes::CenterKeyPoint);
+ if(!pinGeometry)
+  return false;
+
+ std::chrono::steady_clock::time_point startTime = std::chrono::steady_clock::now();
+ size_t createdCount = addAsBuiltRevoluteJoints(asBuiltJoints_, subOcc0, pinOccs, pinGeometry);
+ double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+
+ std::stringstream bulkMessage;
+ bulkMessage << "Created " << createdCount << " of " << pinCount << " as-built joints in " << seconds << " s ("
+  << (seconds > 0 ? createdCount / seconds : 0.0) << " joints/s), all sharing one joint geometry.";
+ ui->messageBox(bulkMessage.str());
+
  // Fit to window
  Ptr<Viewport> viewPort = app->activeViewport();
  if(!viewPort)
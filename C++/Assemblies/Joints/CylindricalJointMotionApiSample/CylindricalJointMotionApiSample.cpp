@@ -3,6 +3,7 @@
 #include <Core/Application/Document.h>
 #include <Core/Application/Product.h>
 #include <Core/Application/ValueInput.h>
+#include <Core/Geometry/Matrix3D.h>
 #include <Core/Geometry/Point3D.h>
 #include <Core/UserInterface/UserInterface.h>
 #include <Fusion/BRep/BRepFace.h>
@@ -15,6 +16,7 @@
 #include <Fusion/Components/Joints.h>
 #include <Fusion/Components/CylindricalJointMotion.h>
 #include <Fusion/Components/Occurrence.h>
+#include <Fusion/Components/OccurrenceList.h>
 #include <Fusion/Components/Occurrences.h>
 #include <Fusion/Construction/ConstructionPlane.h>
 #include <Fusion/Features/Features.h>
@@ -36,11 +38,174 @@
 #include <Fusion/Sketch/SketchPoint.h>
 #include <Fusion/Sketch/SketchPoints.h>
 
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#ifndef XI_WIN
+#include <dlfcn.h>
+#endif
+
 using namespace adsk::core;
 using namespace adsk::fusion;
 
 Ptr<UserInterface> ui;
 
+std::string getDllPath();
+
+// Number of values stored per occurrence: the first three rows of its 4x4 transform,
+// the last row of a rigid transform being always (0, 0, 0, 1).
+const size_t trajectoryValuesPerOccurrence = 12;
+
+// Header of a trajectory file. All the records of the file are multiples of 8 bytes
+// so that the file can be memory mapped and read in place.
+struct TrajectoryFileHeader
+{
+ char tag[4];
+ uint32_t version;
+ uint32_t occurrenceCount;
+ uint32_t keyframeInterval;
+ uint64_t frameCount;
+ uint64_t indexOffset;
+};
+
+// Header of a frame record. A keyframe stores the values of all the occurrences.
+// Any other frame stores a bit mask of the occurrences whose transform changed since
+// the previous frame (one uint64 per 64 occurrences) followed by their values only.
+struct TrajectoryFrameHeader
+{
+ uint32_t isKeyframe;
+ uint32_t changedCount;
+};
+
+// Writes occurrence transforms frame by frame to a binary trajectory file. Only the
+// previous frame is kept in memory; the offsets of the frames are written at the end
+// of the file so that any frame can be reached without reading the ones before it.
+// BallJointMotionApiSample shows how to read the frames back with TrajectoryReader.
+class TrajectoryWriter
+{
+public:
+ ~TrajectoryWriter()
+ {
+  close();
+ }
+
+ bool open(const std::string& filePath, size_t occurrenceCount, size_t keyframeInterval = 100)
+ {
+  close();
+  m_file.open(filePath, std::ios::binary | std::ios::trunc);
+  if (!m_file)
+   return false;
+
+  m_occurrenceCount = occurrenceCount;
+  m_keyframeInterval = keyframeInterval > 0 ? keyframeInterval : 1;
+  m_previousFrame.clear();
+  m_frameOffsets.clear();
+
+  TrajectoryFileHeader header = {};
+  header.tag[0] = 'T'; header.tag[1] = 'R'; header.tag[2] = 'J'; header.tag[3] = 'F';
+  header.version = 1;
+  header.occurrenceCount = static_cast<uint32_t>(m_occurrenceCount);
+  header.keyframeInterval = static_cast<uint32_t>(m_keyframeInterval);
+  m_file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+  return m_file.good();
+ }
+
+ // Writes one frame; transforms holds trajectoryValuesPerOccurrence values per occurrence.
+ bool writeFrame(const std::vector<double>& transforms)
+ {
+  if (!m_file.is_open() || transforms.size() != m_occurrenceCount * trajectoryValuesPerOccurrence)
+   return false;
+
+  m_frameOffsets.push_back(static_cast<uint64_t>(m_file.tellp()));
+
+  TrajectoryFrameHeader frameHeader = {};
+  bool isKeyframe = (m_frameOffsets.size() - 1) % m_keyframeInterval == 0;
+  if (isKeyframe)
+  {
+   frameHeader.isKeyframe = 1;
+   frameHeader.changedCount = static_cast<uint32_t>(m_occurrenceCount);
+   m_file.write(reinterpret_cast<const char*>(&frameHeader), sizeof(frameHeader));
+   m_file.write(reinterpret_cast<const char*>(transforms.data()), transforms.size() * sizeof(double));
+  }
+  else
+  {
+   std::vector<uint64_t> changedMask((m_occurrenceCount + 63) / 64, 0);
+   for (size_t i = 0; i < m_occurrenceCount; ++i)
+   {
+    size_t first = i * trajectoryValuesPerOccurrence;
+    if (memcmp(&transforms[first], &m_previousFrame[first], trajectoryValuesPerOccurrence * sizeof(double)) != 0)
+    {
+     changedMask[i / 64] |= uint64_t(1) << (i % 64);
+     ++frameHeader.changedCount;
+    }
+   }
+
+   m_file.write(reinterpret_cast<const char*>(&frameHeader), sizeof(frameHeader));
+   m_file.write(reinterpret_cast<const char*>(changedMask.data()), changedMask.size() * sizeof(uint64_t));
+   for (size_t i = 0; i < m_occurrenceCount; ++i)
+   {
+    if (changedMask[i / 64] & (uint64_t(1) << (i % 64)))
+     m_file.write(reinterpret_cast<const char*>(&transforms[i * trajectoryValuesPerOccurrence]), trajectoryValuesPerOccurrence * sizeof(double));
+   }
+  }
+
+  m_previousFrame = transforms;
+  return m_file.good();
+ }
+
+ // Writes the frame index and completes the header.
+ bool close()
+ {
+  if (!m_file.is_open())
+   return true;
+
+  uint64_t indexOffset = static_cast<uint64_t>(m_file.tellp());
+  m_file.write(reinterpret_cast<const char*>(m_frameOffsets.data()), m_frameOffsets.size() * sizeof(uint64_t));
+
+  uint64_t frameCount = m_frameOffsets.size();
+  m_file.seekp(offsetof(TrajectoryFileHeader, frameCount));
+  m_file.write(reinterpret_cast<const char*>(&frameCount), sizeof(frameCount));
+  m_file.write(reinterpret_cast<const char*>(&indexOffset), sizeof(indexOffset));
+
+  bool isSuccess = m_file.good();
+  m_file.close();
+  return isSuccess;
+ }
+
+ size_t frameCount() const { return m_frameOffsets.size(); }
+
+private:
+ std::ofstream m_file;
+ size_t m_occurrenceCount = 0;
+ size_t m_keyframeInterval = 1;
+ std::vector<double> m_previousFrame;
+ std::vector<uint64_t> m_frameOffsets;
+};
+
+// Gets the transforms of the occurrences, trajectoryValuesPerOccurrence values each.
+bool getOccurrenceTransforms(const std::vector< Ptr<Occurrence> >& occurrences, std::vector<double>& transforms)
+{
+ transforms.resize(occurrences.size() * trajectoryValuesPerOccurrence);
+ for (size_t i = 0; i < occurrences.size(); ++i)
+ {
+  if (!occurrences[i])
+   return false;
+  Ptr<Matrix3D> transform = occurrences[i]->transform();
+  if (!transform)
+   return false;
+  std::vector<double> values = transform->asArray();
+  if (values.size() < trajectoryValuesPerOccurrence)
+   return false;
+  std::copy(values.begin(), values.begin() + trajectoryValuesPerOccurrence, transforms.begin() + i * trajectoryValuesPerOccurrence);
+ }
+ return true;
+}
+
 extern "C" XI_EXPORT bool run(const char* context)
 {
  Ptr<Application> app = Application::get();
@@ -219,6 +384,38 @@ extern "C" XI_EXPORT bool run(const char* context)
  slideLimits->isMinimumValueEnabled(true);
  slideLimits->minimumValue(0.1);
 
+ // Record the occurrences while the joint turns one revolution and slides along its axis
+ double startRotation = cylindricalMotion->rotationValue();
+ double startSlide = cylindricalMotion->slideValue();
+ Ptr<OccurrenceList> allOccs = rootComp->allOccurrences();
+ if(!allOccs)
+  return false;
+ std::vector< Ptr<Occurrence> > recordedOccs;
+ for (size_t i = 0; i < allOccs->count(); ++i)
+  recordedOccs.push_back(allOccs->item(i));
+
+ std::string trajectoryPath = getDllPath() + "/" + "CylindricalJointMotion.trj";
+ TrajectoryWriter writer;
+ if(!writer.open(trajectoryPath, recordedOccs.size()))
+  return false;
+ const size_t frameCount = 360;
+ std::vector<double> transforms;
+ for (size_t frame = 0; frame < frameCount; ++frame)
+ {
+  double t = static_cast<double>(frame) / (frameCount - 1);
+  cylindricalMotion->rotationValue(t * 2 * 3.14);
+  cylindricalMotion->slideValue(0.1 + t * 2.0);
+  if(!getOccurrenceTransforms(recordedOccs, transforms) || !writer.writeFrame(transforms))
+   return false;
+ }
+ if(!writer.close())
+  return false;
+ cylindricalMotion->rotationValue(startRotation);
+ cylindricalMotion->slideValue(startSlide);
+
+ ui->messageBox("Recorded " + std::to_string(writer.frameCount()) + " frames of " + std::to_string(recordedOccs.size()) +
+  " occurrences to " + trajectoryPath);
+
  return true;
 }
 
@@ -240,4 +437,33 @@ BOOL APIENTRY DllMain(HMODULE hmodule, DWORD reason, LPVOID reserved)
  return TRUE;
 }
 
-#endif // XI_WIN
\ No newline at end of file
+#endif // XI_WIN
+
+std::string getDllPath()
+{
+#if defined(_WINDOWS) || defined(_WIN32) || defined(_WIN64)
+ HMODULE hModule = NULL;
+ if (!GetModuleHandleExA(GET_MODULE_HANDLE_EX_FLAG_FROM_ADDRESS |
+  GET_MODULE_HANDLE_EX_FLAG_UNCHANGED_REFCOUNT,
+  (LPCSTR)&getDllPath,
+  &hModule))
+  return "";
+
+ char winTempPath[2048];
+ ::GetModuleFileNameA(hModule, winTempPath, 2048);
+
+ std::string strPath = winTempPath;
+ size_t stPos = strPath.rfind('\\');
+ return strPath.substr(0, stPos);
+#else
+ Dl_info info;
+ dladdr((void*)getDllPath, &info);
+
+ std::string strPath = info.dli_fname;
+ int stPos = (int)strPath.rfind('/');
+ if (stPos != -1)
+  return strPath.substr(0, stPos);
+ else
+  return "";
+#endif
+}
@@ -3,18 +3,33 @@
 #include <Core/Application/Document.h>
 #include <Core/Application/Product.h>
 #include <Core/Application/ValueInput.h>
+#include <Core/Geometry/Matrix3D.h>
 #include <Core/Geometry/Point3D.h>
+#include <Core/Geometry/Vector3D.h>
 #include <Core/Geometry/Line3D.h>
 #include <Core/UserInterface/UserInterface.h>
+#include <Fusion/BRep/BRepEdge.h>
 #include <Fusion/BRep/BRepFace.h>
 #include <Fusion/BRep/BRepFaces.h>
+#include <Fusion/BRep/BRepVertex.h>
+#include <Fusion/Components/BallJointMotion.h>
 #include <Fusion/Components/Component.h>
+#include <Fusion/Components/CylindricalJointMotion.h>
 #include <Fusion/Components/Joint.h>
 #include <Fusion/Components/JointGeometry.h>
 #include <Fusion/Components/JointInput.h>
 #include <Fusion/Components/JointLimits.h>
+#include <Fusion/Components/JointMotion.h>
+#include <Fusion/Components/JointOrigin.h>
 #include <Fusion/Components/Joints.h>
+#include <Fusion/Components/Occurrence.h>
+#include <Fusion/Components/Occurrences.h>
+#include <Fusion/Components/PinSlotJointMotion.h>
+#include <Fusion/Components/PlanarJointMotion.h>
+#include <Fusion/Components/RevoluteJointMotion.h>
+#include <Fusion/Components/SliderJointMotion.h>
 #include <Fusion/Construction/ConstructionPlane.h>
+#include <Fusion/Construction/ConstructionPoint.h>
 #include <Fusion/Features/Features.h>
 #include <Fusion/Features/ExtrudeFeature.h>
 #include <Fusion/Features/ExtrudeFeatures.h>
@@ -27,14 +42,802 @@
 #include <Fusion/Sketch/SketchCircle.h>
 #include <Fusion/Sketch/SketchCircles.h>
 #include <Fusion/Sketch/SketchCurves.h>
+#include <Fusion/Sketch/SketchEntity.h>
 #include <Fusion/Sketch/SketchLine.h>
 #include <Fusion/Sketch/SketchLines.h>
 
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <map>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
 using namespace adsk::core;
 using namespace adsk::fusion;
 
 Ptr<UserInterface> ui;
 
+// Values stored per pose: the first three rows of a 4x4 rigid transform.
+const size_t poseValueCount = 12;
+
+// Maximum number of values and axes of a joint (planar and ball joints).
+const size_t maxJointValueCount = 3;
+
+// Gets c = a * b for two poses.
+void multiplyPoses(const double* a, const double* b, double* c)
+{
+ for (size_t row = 0; row < 3; ++row)
+ {
+  const double* aRow = a + row * 4;
+  for (size_t column = 0; column < 4; ++column)
+   c[row * 4 + column] = aRow[0] * b[column] + aRow[1] * b[4 + column] + aRow[2] * b[8 + column];
+  c[row * 4 + 3] += aRow[3];
+ }
+}
+
+// Gets the inverse of a rigid pose: the transposed rotation and the rotated, negated translation.
+void invertRigidPose(const double* a, double* inverse)
+{
+ for (size_t row = 0; row < 3; ++row)
+ {
+  for (size_t column = 0; column < 3; ++column)
+   inverse[row * 4 + column] = a[column * 4 + row];
+  inverse[row * 4 + 3] = -(a[row] * a[3] + a[4 + row] * a[7] + a[8 + row] * a[11]);
+ }
+}
+
+// Gets the pose rotating by angle around the unit axis through the point.
+void setRotationPose(const double* point, const double* axis, double angle, double* pose)
+{
+ double c = cos(angle), s = sin(angle), t = 1.0 - c;
+ double x = axis[0], y = axis[1], z = axis[2];
+ double rotation[9] = {
+  t * x * x + c, t * x * y - s * z, t * x * z + s * y,
+  t * x * y + s * z, t * y * y + c, t * y * z - s * x,
+  t * x * z - s * y, t * y * z + s * x, t * z * z + c };
+ for (size_t row = 0; row < 3; ++row)
+ {
+  pose[row * 4] = rotation[row * 3];
+  pose[row * 4 + 1] = rotation[row * 3 + 1];
+  pose[row * 4 + 2] = rotation[row * 3 + 2];
+  pose[row * 4 + 3] = point[row] - (rotation[row * 3] * point[0] + rotation[row * 3 + 1] * point[1] + rotation[row * 3 + 2] * point[2]);
+ }
+}
+
+void setIdentityPose(double* pose)
+{
+ for (size_t i = 0; i < poseValueCount; ++i)
+  pose[i] = i % 5 == 0 ? 1.0 : 0.0;
+}
+
+// Gets the pose translating by distance along the unit direction.
+void setTranslationPose(const double* direction, double distance, double* pose)
+{
+ for (size_t row = 0; row < 3; ++row)
+ {
+  for (size_t column = 0; column < 3; ++column)
+   pose[row * 4 + column] = row == column ? 1.0 : 0.0;
+  pose[row * 4 + 3] = direction[row] * distance;
+ }
+}
+
+bool getPose(const Ptr<Matrix3D>& matrix, double* pose)
+{
+ if (!matrix)
+  return false;
+ std::vector<double> values = matrix->asArray();
+ if (values.size() < poseValueCount)
+  return false;
+ std::copy(values.begin(), values.begin() + poseValueCount, pose);
+ return true;
+}
+
+bool getUnitVector(const Ptr<Vector3D>& vector, double* values)
+{
+ if (!vector)
+  return false;
+ double length = vector->length();
+ if (length <= 0)
+  return false;
+ values[0] = vector->x() / length;
+ values[1] = vector->y() / length;
+ values[2] = vector->z() / length;
+ return true;
+}
+
+// Gets the range of a joint value, unbounded where a limit is not enabled.
+void getLimitRange(const Ptr<JointLimits>& limits, double& minimumValue, double& maximumValue)
+{
+ minimumValue = -std::numeric_limits<double>::infinity();
+ maximumValue = std::numeric_limits<double>::infinity();
+ if (!limits)
+  return;
+ if (limits->isMinimumValueEnabled())
+  minimumValue = limits->minimumValue();
+ if (limits->isMaximumValueEnabled())
+  maximumValue = limits->maximumValue();
+}
+
+// Kind of motion driven by each value of a joint, applied in the order of the values.
+enum JointValueKinds { RotationJointValue, TranslationJointValue };
+
+// Gets the values of the joint motion with, for each one, its kind, its axis in world
+// coordinates, its current value and its limits. Returns the number of values.
+// The axes are those of the current pose and are kept fixed when the values change.
+// That is exact for one value, and for the rotation and the slide of a cylindrical or
+// pin-slot joint, which do not move each other's axis. The slide directions of a
+// planar joint turn with its rotation, and the yaw and roll axes of a ball joint turn
+// with its pitch and yaw, so poses of those joints away from the current values are
+// approximations.
+size_t getJointMotionValues(const Ptr<JointMotion>& motion, JointValueKinds* kinds, double* axes, double* values, double* minimumValues, double* maximumValues)
+{
+ if (!motion)
+  return 0;
+
+ Ptr<Vector3D> vectors[maxJointValueCount];
+ Ptr<JointLimits> limits[maxJointValueCount];
+ size_t valueCount = 0;
+ switch (motion->jointType())
+ {
+ case JointTypes::RevoluteJointType:
+ {
+  Ptr<RevoluteJointMotion> revoluteMotion = motion;
+  if (!revoluteMotion)
+   return 0;
+  kinds[0] = RotationJointValue; vectors[0] = revoluteMotion->rotationAxisVector(); values[0] = revoluteMotion->rotationValue(); limits[0] = revoluteMotion->rotationLimits();
+  valueCount = 1;
+  break;
+ }
+ case JointTypes::SliderJointType:
+ {
+  Ptr<SliderJointMotion> sliderMotion = motion;
+  if (!sliderMotion)
+   return 0;
+  kinds[0] = TranslationJointValue; vectors[0] = sliderMotion->slideDirectionVector(); values[0] = sliderMotion->slideValue(); limits[0] = sliderMotion->slideLimits();
+  valueCount = 1;
+  break;
+ }
+ case JointTypes::CylindricalJointType:
+ {
+  Ptr<CylindricalJointMotion> cylindricalMotion = motion;
+  if (!cylindricalMotion)
+   return 0;
+  kinds[0] = RotationJointValue; vectors[0] = cylindricalMotion->rotationAxisVector(); values[0] = cylindricalMotion->rotationValue(); limits[0] = cylindricalMotion->rotationLimits();
+  kinds[1] = TranslationJointValue; vectors[1] = vectors[0]; values[1] = cylindricalMotion->slideValue(); limits[1] = cylindricalMotion->slideLimits();
+  valueCount = 2;
+  break;
+ }
+ case JointTypes::PinSlotJointType:
+ {
+  Ptr<PinSlotJointMotion> pinSlotMotion = motion;
+  if (!pinSlotMotion)
+   return 0;
+  kinds[0] = RotationJointValue; vectors[0] = pinSlotMotion->rotationAxisVector(); values[0] = pinSlotMotion->rotationValue(); limits[0] = pinSlotMotion->rotationLimits();
+  kinds[1] = TranslationJointValue; vectors[1] = pinSlotMotion->slideDirectionVector(); values[1] = pinSlotMotion->slideValue(); limits[1] = pinSlotMotion->slideLimits();
+  valueCount = 2;
+  break;
+ }
+ case JointTypes::PlanarJointType:
+ {
+  Ptr<PlanarJointMotion> planarMotion = motion;
+  if (!planarMotion)
+   return 0;
+  kinds[0] = RotationJointValue; vectors[0] = planarMotion->normalDirectionVector(); values[0] = planarMotion->rotationValue(); limits[0] = planarMotion->rotationLimits();
+  kinds[1] = TranslationJointValue; vectors[1] = planarMotion->primarySlideDirectionVector(); values[1] = planarMotion->primarySlideValue(); limits[1] = planarMotion->primarySlideLimits();
+  kinds[2] = TranslationJointValue; vectors[2] = planarMotion->secondarySlideDirectionVector(); values[2] = planarMotion->secondarySlideValue(); limits[2] = planarMotion->secondarySlideLimits();
+  valueCount = 3;
+  break;
+ }
+ case JointTypes::BallJointType:
+ {
+  Ptr<BallJointMotion> ballMotion = motion;
+  if (!ballMotion)
+   return 0;
+  kinds[0] = RotationJointValue; vectors[0] = ballMotion->pitchDirectionVector(); values[0] = ballMotion->pitchValue(); limits[0] = ballMotion->pitchLimits();
+  kinds[1] = RotationJointValue; vectors[1] = ballMotion->yawDirectionVector(); values[1] = ballMotion->yawValue(); limits[1] = ballMotion->yawLimits();
+  kinds[2] = RotationJointValue; vectors[2] = ballMotion->rollDirectionVector(); values[2] = ballMotion->rollValue(); limits[2] = ballMotion->rollLimits();
+  valueCount = 3;
+  break;
+ }
+ default:
+  return 0;
+ }
+
+ for (size_t i = 0; i < valueCount; ++i)
+ {
+  if (!getUnitVector(vectors[i], axes + i * 3))
+   return 0;
+  getLimitRange(limits[i], minimumValues[i], maximumValues[i]);
+ }
+ return valueCount;
+}
+
+// Sets the values of the joint motion, in the order given by getJointMotionValues.
+bool setJointMotionValues(const Ptr<JointMotion>& motion, const double* values)
+{
+ if (!motion)
+  return false;
+
+ switch (motion->jointType())
+ {
+ case JointTypes::RevoluteJointType:
+ {
+  Ptr<RevoluteJointMotion> revoluteMotion = motion;
+  return revoluteMotion && revoluteMotion->rotationValue(values[0]);
+ }
+ case JointTypes::SliderJointType:
+ {
+  Ptr<SliderJointMotion> sliderMotion = motion;
+  return sliderMotion && sliderMotion->slideValue(values[0]);
+ }
+ case JointTypes::CylindricalJointType:
+ {
+  Ptr<CylindricalJointMotion> cylindricalMotion = motion;
+  return cylindricalMotion && cylindricalMotion->rotationValue(values[0]) && cylindricalMotion->slideValue(values[1]);
+ }
+ case JointTypes::PinSlotJointType:
+ {
+  Ptr<PinSlotJointMotion> pinSlotMotion = motion;
+  return pinSlotMotion && pinSlotMotion->rotationValue(values[0]) && pinSlotMotion->slideValue(values[1]);
+ }
+ case JointTypes::PlanarJointType:
+ {
+  Ptr<PlanarJointMotion> planarMotion = motion;
+  return planarMotion && planarMotion->rotationValue(values[0]) && planarMotion->primarySlideValue(values[1]) && planarMotion->secondarySlideValue(values[2]);
+ }
+ case JointTypes::BallJointType:
+ {
+  Ptr<BallJointMotion> ballMotion = motion;
+  return ballMotion && ballMotion->pitchValue(values[0]) && ballMotion->yawValue(values[1]) && ballMotion->rollValue(values[2]);
+ }
+ default:
+  return true;
+ }
+}
+
+// Evaluates the world poses of the occurrences moved by a tree of joints for any
+// vector of joint values, without calling the API. capture() reads the joints once
+// into flat arrays: for each joint, in an order where a parent is posed before its
+// child, the rows of both occurrences, its axes in the parent frame and the pose of
+// the child relative to the parent, which holds the offset and angle of the joint.
+// A joint closing a loop is not evaluated.
+class ForwardKinematics
+{
+public:
+ bool capture(const Ptr<Joints>& joints)
+ {
+  *this = ForwardKinematics();
+  if (!joints)
+   return false;
+
+  // Read the joints and the occurrences they connect; the root component is the ground.
+  const size_t groundRow = static_cast<size_t>(-1);
+  std::map<std::string, size_t> rowOfPath;
+  std::vector< Ptr<Occurrence> > occurrences;
+  std::vector<bool> isGrounded;
+  std::vector< Ptr<Joint> > liveJoints;
+  std::vector<size_t> rowsOne, rowsTwo;
+  for (size_t i = 0; i < joints->count(); ++i)
+  {
+   Ptr<Joint> joint = joints->item(i);
+   if (!joint || joint->isSuppressed())
+    continue;
+   Ptr<Occurrence> jointOccs[2] = { joint->occurrenceOne(), joint->occurrenceTwo() };
+   size_t jointRows[2] = { groundRow, groundRow };
+   for (size_t side = 0; side < 2; ++side)
+   {
+    if (!jointOccs[side])
+     continue;
+    std::string path = jointOccs[side]->fullPathName();
+    std::map<std::string, size_t>::const_iterator found = rowOfPath.find(path);
+    if (found == rowOfPath.end())
+    {
+     found = rowOfPath.insert(std::make_pair(path, occurrences.size())).first;
+     occurrences.push_back(jointOccs[side]);
+     isGrounded.push_back(jointOccs[side]->isGrounded());
+    }
+    jointRows[side] = found->second;
+   }
+   liveJoints.push_back(joint);
+   rowsOne.push_back(jointRows[0]);
+   rowsTwo.push_back(jointRows[1]);
+  }
+
+  size_t occurrenceCount = occurrences.size();
+  m_occurrences = occurrences;
+  m_capturedPoses.resize((occurrenceCount + 1) * poseValueCount);
+  for (size_t row = 0; row < occurrenceCount; ++row)
+  {
+   if (!getPose(occurrences[row]->transform(), &m_capturedPoses[row * poseValueCount]))
+    return false;
+  }
+  setIdentityPose(&m_capturedPoses[occurrenceCount * poseValueCount]);
+  for (size_t i = 0; i < rowsOne.size(); ++i)
+  {
+   if (rowsOne[i] == groundRow)
+    rowsOne[i] = occurrenceCount;
+   if (rowsTwo[i] == groundRow)
+    rowsTwo[i] = occurrenceCount;
+  }
+
+  // Order the joints breadth first from the ground and the grounded occurrences,
+  // which keep their pose, then from any occurrence left, which is taken as fixed.
+  std::vector< std::vector<size_t> > jointsOfRow(occurrenceCount + 1);
+  for (size_t i = 0; i < liveJoints.size(); ++i)
+  {
+   jointsOfRow[rowsOne[i]].push_back(i);
+   jointsOfRow[rowsTwo[i]].push_back(i);
+  }
+  std::vector<bool> isPosed(occurrenceCount + 1, false);
+  std::vector<bool> isJointVisited(liveJoints.size(), false);
+  std::vector<size_t> queue(1, occurrenceCount);
+  isPosed[occurrenceCount] = true;
+  for (size_t row = 0; row < occurrenceCount; ++row)
+  {
+   if (isGrounded[row])
+   {
+    isPosed[row] = true;
+    queue.push_back(row);
+   }
+  }
+  for (size_t seed = 0; seed <= occurrenceCount; ++seed)
+  {
+   if (seed > 0)
+   {
+    if (isPosed[seed - 1])
+     continue;
+    isPosed[seed - 1] = true;
+    queue.assign(1, seed - 1);
+   }
+   for (size_t next = 0; next < queue.size(); ++next)
+   {
+    size_t parentRow = queue[next];
+    for (size_t k = 0; k < jointsOfRow[parentRow].size(); ++k)
+    {
+     size_t jointIndex = jointsOfRow[parentRow][k];
+     if (isJointVisited[jointIndex])
+      continue;
+     isJointVisited[jointIndex] = true;
+     bool isReversed = rowsOne[jointIndex] == parentRow;
+     size_t childRow = isReversed ? rowsTwo[jointIndex] : rowsOne[jointIndex];
+     if (isPosed[childRow])
+     {
+      ++m_loopJointCount;
+      continue;
+     }
+     if (!addJoint(liveJoints[jointIndex], parentRow, childRow, isReversed))
+      return false;
+     isPosed[childRow] = true;
+     queue.push_back(childRow);
+    }
+   }
+  }
+  return true;
+ }
+
+ size_t occurrenceCount() const { return m_occurrences.size(); }
+ size_t valueCount() const { return m_capturedValues.size(); }
+ Ptr<Occurrence> occurrence(size_t row) const { return m_occurrences[row]; }
+
+ // Values of the joints when captured, minimum and maximum values, in evaluation order.
+ const std::vector<double>& capturedValues() const { return m_capturedValues; }
+ const std::vector<double>& minimumValues() const { return m_minimumValues; }
+ const std::vector<double>& maximumValues() const { return m_maximumValues; }
+ bool isRotationValue(size_t valueIndex) const { return m_valueKinds[valueIndex] == RotationJointValue; }
+
+ // Number of joints not evaluated because they close a loop.
+ size_t loopJointCount() const { return m_loopJointCount; }
+
+ // Gets the world poses of the occurrences, poseValueCount values per occurrence, for
+ // valueCount() joint values. poses is used as scratch space and must hold one more pose.
+ void evaluate(const double* values, double* poses) const
+ {
+  double motion[poseValueCount], step[poseValueCount], scratch[poseValueCount];
+  memcpy(poses, m_capturedPoses.data(), m_capturedPoses.size() * sizeof(double));
+  for (size_t i = 0; i < m_parentRows.size(); ++i)
+  {
+   setIdentityPose(motion);
+   for (size_t j = m_valueOffsets[i]; j < m_valueOffsets[i + 1]; ++j)
+   {
+    double delta = values[j] - m_capturedValues[j];
+    if (m_valueKinds[j] == RotationJointValue)
+     setRotationPose(&m_axisPoints[i * 3], &m_axes[j * 3], delta, step);
+    else
+     setTranslationPose(&m_axes[j * 3], delta, step);
+    multiplyPoses(step, motion, scratch);
+    memcpy(motion, scratch, sizeof(motion));
+   }
+   if (m_isReversed[i])
+   {
+    invertRigidPose(motion, scratch);
+    memcpy(motion, scratch, sizeof(motion));
+   }
+   multiplyPoses(&poses[m_parentRows[i] * poseValueCount], motion, scratch);
+   multiplyPoses(scratch, &m_restPoses[i * poseValueCount], &poses[m_childRows[i] * poseValueCount]);
+  }
+ }
+
+ // Sets the joint values on the live joints, so the design takes the evaluated pose.
+ bool applyToJoints(const double* values) const
+ {
+  for (size_t i = 0; i < m_joints.size(); ++i)
+  {
+   if (m_valueOffsets[i + 1] == m_valueOffsets[i])
+    continue;
+   if (!setJointMotionValues(m_joints[i]->jointMotion(), values + m_valueOffsets[i]))
+    return false;
+  }
+  return true;
+ }
+
+private:
+ bool addJoint(const Ptr<Joint>& joint, size_t parentRow, size_t childRow, bool isReversed)
+ {
+  JointValueKinds kinds[maxJointValueCount];
+  double axes[maxJointValueCount * 3], values[maxJointValueCount], minimumValues[maxJointValueCount], maximumValues[maxJointValueCount];
+  size_t valueCount = 0;
+  Ptr<JointMotion> motion = joint->jointMotion();
+  if (!motion)
+   return false;
+  if (motion->jointType() != JointTypes::RigidJointType)
+  {
+   valueCount = getJointMotionValues(motion, kinds, axes, values, minimumValues, maximumValues);
+   if (valueCount == 0)
+    return false;
+  }
+
+  // The rotations are around the origin of the joint geometry.
+  double origin[3] = { 0, 0, 0 };
+  Ptr<JointGeometry> geometry = joint->geometryOrOriginOne();
+  if (!geometry)
+  {
+   Ptr<JointOrigin> jointOrigin = joint->geometryOrOriginOne();
+   if (jointOrigin)
+    geometry = jointOrigin->geometry();
+  }
+  if (geometry)
+  {
+   Ptr<Point3D> point = geometry->origin();
+   if (point)
+   {
+    origin[0] = point->x(); origin[1] = point->y(); origin[2] = point->z();
+   }
+  }
+
+  // Express the axes and the child pose in the frame of the parent when captured.
+  const double* parentPose = &m_capturedPoses[parentRow * poseValueCount];
+  double parentInverse[poseValueCount], restPose[poseValueCount];
+  invertRigidPose(parentPose, parentInverse);
+  multiplyPoses(parentInverse, &m_capturedPoses[childRow * poseValueCount], restPose);
+  for (size_t row = 0; row < 3; ++row)
+   m_axisPoints.push_back(parentInverse[row * 4] * origin[0] + parentInverse[row * 4 + 1] * origin[1] + parentInverse[row * 4 + 2] * origin[2] + parentInverse[row * 4 + 3]);
+  for (size_t j = 0; j < valueCount; ++j)
+  {
+   for (size_t row = 0; row < 3; ++row)
+    m_axes.push_back(parentInverse[row * 4] * axes[j * 3] + parentInverse[row * 4 + 1] * axes[j * 3 + 1] + parentInverse[row * 4 + 2] * axes[j * 3 + 2]);
+   m_valueKinds.push_back(kinds[j]);
+   m_capturedValues.push_back(values[j]);
+   m_minimumValues.push_back(minimumValues[j]);
+   m_maximumValues.push_back(maximumValues[j]);
+  }
+  if (m_valueOffsets.empty())
+   m_valueOffsets.push_back(0);
+  m_valueOffsets.push_back(m_capturedValues.size());
+  m_restPoses.insert(m_restPoses.end(), restPose, restPose + poseValueCount);
+  m_parentRows.push_back(parentRow);
+  m_childRows.push_back(childRow);
+  m_isReversed.push_back(isReversed ? 1 : 0);
+  m_joints.push_back(joint);
+  return true;
+ }
+
+ std::vector< Ptr<Occurrence> > m_occurrences;
+ std::vector< Ptr<Joint> > m_joints;
+ std::vector<double> m_capturedPoses;
+
+ // One entry per joint, in evaluation order.
+ std::vector<size_t> m_parentRows;
+ std::vector<size_t> m_childRows;
+ std::vector<char> m_isReversed;
+ std::vector<size_t> m_valueOffsets;
+ std::vector<double> m_axisPoints;
+ std::vector<double> m_restPoses;
+
+ // One entry per joint value.
+ std::vector<JointValueKinds> m_valueKinds;
+ std::vector<double> m_axes;
+ std::vector<double> m_capturedValues;
+ std::vector<double> m_minimumValues;
+ std::vector<double> m_maximumValues;
+
+ size_t m_loopJointCount = 0;
+};
+
+// Gets the entity token of the entities a joint geometry can be created from, or an
+// empty string for any other entity. Unlike the address of the wrapper, the token
+// stays the same for every wrapper of the entity.
+std::string getEntityToken(const Ptr<Base>& entity)
+{
+ if (Ptr<BRepFace> face = entity)
+  return face->entityToken();
+ if (Ptr<BRepEdge> edge = entity)
+  return edge->entityToken();
+ if (Ptr<BRepVertex> vertex = entity)
+  return vertex->entityToken();
+ if (Ptr<SketchEntity> sketchEntity = entity)
+  return sketchEntity->entityToken();
+ if (Ptr<Profile> profile = entity)
+  return profile->entityToken();
+ if (Ptr<ConstructionPoint> constructionPoint = entity)
+  return constructionPoint->entityToken();
+ return std::string();
+}
+
+// Kind of entity a joint geometry is created from.
+enum JointGeometryKinds { PlanarFaceJointGeometry, NonPlanarFaceJointGeometry, CurveJointGeometry, PointJointGeometry, ProfileJointGeometry };
+
+// Describes one side of a joint. A face given in the context of its component is
+// placed in the context of the occurrence, when there is one.
+struct JointGeometrySpec
+{
+ Ptr<Occurrence> occurrence;
+ Ptr<Base> entity;
+ JointGeometryKinds kind = PlanarFaceJointGeometry;
+ JointKeyPointTypes keyPointType = JointKeyPointTypes::CenterKeyPoint;
+};
+
+// One row of a joint table.
+struct JointTableRow
+{
+ JointGeometrySpec geometryOne;
+ JointGeometrySpec geometryTwo;
+ JointTypes jointType = JointTypes::RigidJointType;
+ JointDirections primaryDirection = JointDirections::ZAxisJointDirection;
+ // Slide direction of pin-slot joints and yaw direction of ball joints.
+ JointDirections secondaryDirection = JointDirections::XAxisJointDirection;
+ double angle = 0.0;
+ double offset = 0.0;
+ bool isFlipped = false;
+ // Limits of the first value of the joint (rotation, or slide for slider joints).
+ bool hasLimits = false;
+ double minimumValue = 0.0;
+ double maximumValue = 0.0;
+};
+
+struct BulkJointReport
+{
+ size_t createdCount = 0;
+ std::vector<size_t> failedRows;
+ size_t geometryCacheHits = 0;
+ size_t geometryCacheMisses = 0;
+ double seconds = 0.0;
+
+ double jointsPerSecond() const { return seconds > 0 ? createdCount / seconds : 0.0; }
+};
+
+// Creates the joints of a table. A joint geometry is created once per entity,
+// occurrence and key point and shared by all the rows that use it. The inputs of
+// all the rows are prepared before the first joint is added, so the joints are
+// then added back to back.
+class BulkJointBuilder
+{
+public:
+ BulkJointReport build(const Ptr<Joints>& joints, const std::vector<JointTableRow>& table, std::vector< Ptr<Joint> >& createdJoints)
+ {
+  BulkJointReport report;
+  createdJoints.assign(table.size(), nullptr);
+  if (!joints)
+  {
+   for (size_t i = 0; i < table.size(); ++i)
+    report.failedRows.push_back(i);
+   return report;
+  }
+
+  std::chrono::steady_clock::time_point startTime = std::chrono::steady_clock::now();
+  size_t hitsBefore = m_cacheHits, missesBefore = m_cacheMisses;
+  std::vector< Ptr<JointInput> > inputs(table.size());
+  for (size_t i = 0; i < table.size(); ++i)
+   inputs[i] = createJointInput(joints, table[i]);
+
+  for (size_t i = 0; i < table.size(); ++i)
+  {
+   if (inputs[i])
+    createdJoints[i] = joints->add(inputs[i]);
+   if (!createdJoints[i] || (table[i].hasLimits && !setLimits(createdJoints[i], table[i])))
+   {
+    report.failedRows.push_back(i);
+    continue;
+   }
+   ++report.createdCount;
+  }
+
+  report.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+  report.geometryCacheHits = m_cacheHits - hitsBefore;
+  report.geometryCacheMisses = m_cacheMisses - missesBefore;
+  return report;
+ }
+
+ // Gets the joint geometry of the spec, creating it on first use.
+ Ptr<JointGeometry> getGeometry(const JointGeometrySpec& spec)
+ {
+  // The entity is identified by its token and the occurrence by its path, so that
+  // different wrappers of the same entity share the geometry. An entity without a
+  // token is not cached.
+  std::string entityToken = getEntityToken(spec.entity);
+  std::string occurrencePath = spec.occurrence ? spec.occurrence->fullPathName() : std::string();
+  GeometryKey key(std::make_pair(occurrencePath, entityToken), std::make_pair(static_cast<int>(spec.kind), static_cast<int>(spec.keyPointType)));
+  bool isCached = !entityToken.empty();
+  if (isCached)
+  {
+   std::map<GeometryKey, Ptr<JointGeometry> >::const_iterator found = m_geometries.find(key);
+   if (found != m_geometries.end())
+   {
+    ++m_cacheHits;
+    return found->second;
+   }
+  }
+  ++m_cacheMisses;
+
+  Ptr<JointGeometry> geometry;
+  Ptr<BRepFace> face = spec.entity;
+  if (face && spec.occurrence)
+   face = face->createForAssemblyContext(spec.occurrence);
+  switch (spec.kind)
+  {
+  case PlanarFaceJointGeometry:
+   if (face)
+    geometry = JointGeometry::createByPlanarFace(face, nullptr, spec.keyPointType);
+   break;
+  case NonPlanarFaceJointGeometry:
+   if (face)
+    geometry = JointGeometry::createByNonPlanarFace(face, spec.keyPointType);
+   break;
+  case CurveJointGeometry:
+   geometry = JointGeometry::createByCurve(spec.entity, spec.keyPointType);
+   break;
+  case PointJointGeometry:
+   geometry = JointGeometry::createByPoint(spec.entity);
+   break;
+  case ProfileJointGeometry:
+   geometry = JointGeometry::createByProfile(spec.entity, nullptr, spec.keyPointType);
+   break;
+  }
+
+  // A failure is cached too, so that a bad entity is not retried for every row.
+  if (isCached)
+   m_geometries[key] = geometry;
+  return geometry;
+ }
+
+ void clearCache()
+ {
+  m_geometries.clear();
+ }
+
+private:
+ // Occurrence path, entity token, kind and key point.
+ typedef std::pair< std::pair<std::string, std::string>, std::pair<int, int> > GeometryKey;
+
+ Ptr<JointInput> createJointInput(const Ptr<Joints>& joints, const JointTableRow& row)
+ {
+  Ptr<JointGeometry> geometryOne = getGeometry(row.geometryOne);
+  Ptr<JointGeometry> geometryTwo = getGeometry(row.geometryTwo);
+  if (!geometryOne || !geometryTwo)
+   return nullptr;
+
+  Ptr<JointInput> input = joints->createInput(geometryOne, geometryTwo);
+  if (!input)
+   return nullptr;
+  if (row.angle != 0.0)
+   input->angle(ValueInput::createByReal(row.angle));
+  if (row.offset != 0.0)
+   input->offset(ValueInput::createByReal(row.offset));
+  input->isFlipped(row.isFlipped);
+
+  bool isSet = false;
+  switch (row.jointType)
+  {
+  case JointTypes::RigidJointType:
+   isSet = input->setAsRigidJointMotion();
+   break;
+  case JointTypes::RevoluteJointType:
+   isSet = input->setAsRevoluteJointMotion(row.primaryDirection);
+   break;
+  case JointTypes::SliderJointType:
+   isSet = input->setAsSliderJointMotion(row.primaryDirection);
+   break;
+  case JointTypes::CylindricalJointType:
+   isSet = input->setAsCylindricalJointMotion(row.primaryDirection);
+   break;
+  case JointTypes::PinSlotJointType:
+   isSet = input->setAsPinSlotJointMotion(row.primaryDirection, row.secondaryDirection);
+   break;
+  case JointTypes::PlanarJointType:
+   isSet = input->setAsPlanarJointMotion(row.primaryDirection);
+   break;
+  case JointTypes::BallJointType:
+   isSet = input->setAsBallJointMotion(row.primaryDirection, row.secondaryDirection);
+   break;
+  default:
+   break;
+  }
+  return isSet ? input : nullptr;
+ }
+
+ static bool setLimits(const Ptr<Joint>& joint, const JointTableRow& row)
+ {
+  Ptr<JointMotion> motion = joint->jointMotion();
+  if (!motion)
+   return false;
+
+  Ptr<JointLimits> limits;
+  switch (motion->jointType())
+  {
+  case JointTypes::RevoluteJointType:
+  {
+   Ptr<RevoluteJointMotion> revoluteMotion = motion;
+   if (revoluteMotion)
+    limits = revoluteMotion->rotationLimits();
+   break;
+  }
+  case JointTypes::SliderJointType:
+  {
+   Ptr<SliderJointMotion> sliderMotion = motion;
+   if (sliderMotion)
+    limits = sliderMotion->slideLimits();
+   break;
+  }
+  case JointTypes::CylindricalJointType:
+  {
+   Ptr<CylindricalJointMotion> cylindricalMotion = motion;
+   if (cylindricalMotion)
+    limits = cylindricalMotion->rotationLimits();
+   break;
+  }
+  case JointTypes::PinSlotJointType:
+  {
+   Ptr<PinSlotJointMotion> pinSlotMotion = motion;
+   if (pinSlotMotion)
+    limits = pinSlotMotion->rotationLimits();
+   break;
+  }
+  case JointTypes::PlanarJointType:
+  {
+   Ptr<PlanarJointMotion> planarMotion = motion;
+   if (planarMotion)
+    limits = planarMotion->rotationLimits();
+   break;
+  }
+  case JointTypes::BallJointType:
+  {
+   Ptr<BallJointMotion> ballMotion = motion;
+   if (ballMotion)
+    limits = ballMotion->pitchLimits();
+   break;
+  }
+  default:
+   break;
+  }
+  if (!limits)
+   return false;
+
+  limits->isMinimumValueEnabled(true);
+  limits->minimumValue(row.minimumValue);
+  limits->isMaximumValueEnabled(true);
+  limits->maximumValue(row.maximumValue);
+  return true;
+ }
+
+ std::map<GeometryKey, Ptr<JointGeometry> > m_geometries;
+ size_t m_cacheHits = 0;
+ size_t m_cacheMisses = 0;
+};
+
 extern "C" XI_EXPORT bool run(const char* context)
 {
  Ptr<Application> app = Application::get();
@@ -174,6 +977,99 @@ extern "C" XI_EXPORT bool run(const char* context)
  Ptr<Joint> joint = joints->add(jointInput);
  if(!joint)
   return false;
+
+ // Sample the joint values in pure C++ and pose the joint where the moving occurrence is farthest from the origin
+ ForwardKinematics kinematics;
+ if(!kinematics.capture(joints) || kinematics.occurrenceCount() == 0)
+  return false;
+ const double pi = 3.14159265358979323846;
+ std::vector<double> values = kinematics.capturedValues();
+ std::vector< std::uniform_real_distribution<double> > distributions;
+ for (size_t i = 0; i < values.size(); ++i)
+ {
+  // Sample around the current value, brought back within the limits, so that the
+  // bounds are always ordered even when the joint is outside of its limits.
+  double range = kinematics.isRotationValue(i) ? pi : 10.0;
+  double lowestValue = std::min(kinematics.minimumValues()[i], kinematics.maximumValues()[i]);
+  double highestValue = std::max(kinematics.minimumValues()[i], kinematics.maximumValues()[i]);
+  double centerValue = std::min(std::max(values[i], lowestValue), highestValue);
+  double minimumValue = std::max(lowestValue, centerValue - range);
+  double maximumValue = std::min(highestValue, centerValue + range);
+  distributions.push_back(std::uniform_real_distribution<double>(minimumValue, maximumValue));
+ }
+ std::vector<double> farthestValues = values;
+ std::vector<double> poses((kinematics.occurrenceCount() + 1) * poseValueCount);
+ std::mt19937 generator(1);
+ double farthestDistance = -1.0;
+ const size_t sampleCount = 1000000;
+ std::chrono::steady_clock::time_point startTime = std::chrono::steady_clock::now();
+ for (size_t sample = 0; sample < sampleCount; ++sample)
+ {
+  for (size_t i = 0; i < values.size(); ++i)
+   values[i] = distributions[i](generator);
+  kinematics.evaluate(values.data(), poses.data());
+  double distance = poses[3] * poses[3] + poses[7] * poses[7] + poses[11] * poses[11];
+  if (distance > farthestDistance)
+  {
+   farthestDistance = distance;
+   farthestValues = values;
+  }
+ }
+ double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+ if(!kinematics.applyToJoints(farthestValues.data()))
+  return false;
+
+ std::stringstream report;
+ report << "Evaluated " << sampleCount << " poses in " << seconds << " s (" << (seconds > 0 ? sampleCount / seconds : 0) << " poses/s).\n"
+  << "Farthest distance of " << kinematics.occurrence(0)->name() << " from the origin: " << sqrt(farthestDistance) << " cm";
+ ui->messageBox(report.str());
+
+ // Stack copies of the component on the sketch line with a table of revolute joints
+ Ptr<Occurrences> occs = rootComp->occurrences();
+ if(!occs)
+  return false;
+ Ptr<Occurrence> firstOcc = occs->item(0);
+ if(!firstOcc)
+  return false;
+ Ptr<Component> cylinderComp = firstOcc->component();
+ if(!cylinderComp)
+  return false;
+ Ptr<BRepFace> nativeEndFace = endFace->nativeObject();
+ if(!nativeEndFace)
+  return false;
+ const size_t copyCount = 50;
+ std::vector<JointTableRow> jointTable;
+ for (size_t i = 0; i < copyCount; ++i)
+ {
+  Ptr<Occurrence> copyOcc = occs->addExistingComponent(cylinderComp, Matrix3D::create());
+  if(!copyOcc)
+   return false;
+  JointTableRow row;
+  row.geometryOne.occurrence = copyOcc;
+  row.geometryOne.entity = nativeEndFace;
+  row.geometryOne.kind = PlanarFaceJointGeometry;
+  row.geometryOne.keyPointType = JointKeyPointTypes::CenterKeyPoint;
+  row.geometryTwo.entity = line;
+  row.geometryTwo.kind = CurveJointGeometry;
+  row.geometryTwo.keyPointType = JointKeyPointTypes::StartKeyPoint;
+  row.jointType = JointTypes::RevoluteJointType;
+  row.primaryDirection = JointDirections::ZAxisJointDirection;
+  row.offset = 5.0 * (i + 1);
+  row.hasLimits = true;
+  row.minimumValue = 0.0;
+  row.maximumValue = pi;
+  jointTable.push_back(row);
+ }
+ BulkJointBuilder jointBuilder;
+ std::vector< Ptr<Joint> > tableJoints;
+ BulkJointReport bulkReport = jointBuilder.build(joints, jointTable, tableJoints);
+
+ std::stringstream bulkMessage;
+ bulkMessage << "Created " << bulkReport.createdCount << " of " << jointTable.size() << " joints in " << bulkReport.seconds << " s ("
+  << bulkReport.jointsPerSecond() << " joints/s).\n"
+  << "Joint geometries created: " << bulkReport.geometryCacheMisses << ", reused: " << bulkReport.geometryCacheHits;
+ ui->messageBox(bulkMessage.str());
+
  // Lock the joint
  joint->isLocked(true);
  // Get health state of a joint
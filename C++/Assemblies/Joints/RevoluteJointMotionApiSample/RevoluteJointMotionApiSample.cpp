@@ -15,6 +15,8 @@
 #include <Fusion/Components/Joints.h>
 #include <Fusion/Components/RevoluteJointMotion.h>
 #include <Fusion/Construction/ConstructionPlane.h>
+#include <Fusion/Construction/ConstructionPlaneInput.h>
+#include <Fusion/Construction/ConstructionPlanes.h>
 #include <Fusion/Features/Features.h>
 #include <Fusion/Features/ExtrudeFeature.h>
 #include <Fusion/Features/ExtrudeFeatures.h>
@@ -27,12 +29,368 @@
 #include <Fusion/Sketch/SketchCircle.h>
 #include <Fusion/Sketch/SketchCircles.h>
 #include <Fusion/Sketch/SketchCurves.h>
+#include <Fusion/Sketch/SketchLines.h>
+#include <Fusion/BRep/BRepBodies.h>
+#include <Fusion/BRep/BRepBody.h>
+#include <Fusion/Components/Occurrence.h>
+#include <Fusion/Components/OccurrenceList.h>
+#include <Fusion/Components/SliderJointMotion.h>
+#include <Core/Geometry/BoundingBox3D.h>
+#include <Core/Geometry/Matrix3D.h>
+#include <Core/Geometry/Plane.h>
+#include <Core/Geometry/Vector3D.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <sstream>
+#include <utility>
+#include <vector>
 
 using namespace adsk::core;
 using namespace adsk::fusion;
 
 Ptr<UserInterface> ui;
 
+// Axis aligned bounding box in world space.
+struct Aabb
+{
+ double min[3];
+ double max[3];
+};
+
+bool overlaps(const Aabb& a, const Aabb& b)
+{
+ return a.min[0] <= b.max[0] && b.min[0] <= a.max[0] &&
+  a.min[1] <= b.max[1] && b.min[1] <= a.max[1] &&
+  a.min[2] <= b.max[2] && b.min[2] <= a.max[2];
+}
+
+bool getBodyBoundingBox(const Ptr<BRepBody>& body, Aabb& box)
+{
+ if (!body)
+  return false;
+ Ptr<BoundingBox3D> boundingBox = body->boundingBox();
+ if (!boundingBox)
+  return false;
+ Ptr<Point3D> minPoint = boundingBox->minPoint();
+ Ptr<Point3D> maxPoint = boundingBox->maxPoint();
+ if (!minPoint || !maxPoint)
+  return false;
+ minPoint->getData(box.min[0], box.min[1], box.min[2]);
+ maxPoint->getData(box.max[0], box.max[1], box.max[2]);
+ return true;
+}
+
+// Bounding volume hierarchy over the bounding boxes of the bodies that do not move.
+// Nodes are stored in a flat array, each leaf holding a few boxes.
+class StaticSceneBvh
+{
+public:
+ void build(const std::vector<Aabb>& boxes)
+ {
+  m_boxes = boxes;
+  m_nodes.clear();
+  m_order.resize(m_boxes.size());
+  for (uint32_t i = 0; i < m_order.size(); ++i)
+   m_order[i] = i;
+  if (!m_boxes.empty())
+   buildNode(0, static_cast<uint32_t>(m_order.size()));
+ }
+
+ bool isEmpty() const { return m_nodes.empty(); }
+ size_t boxCount() const { return m_boxes.size(); }
+
+ // Returns true if the box overlaps the box of any static body.
+ bool overlapsAny(const Aabb& box) const
+ {
+  if (m_nodes.empty())
+   return false;
+
+  std::vector<uint32_t> stack(1, 0);
+  while (!stack.empty())
+  {
+   const Node& node = m_nodes[stack.back()];
+   stack.pop_back();
+   if (!overlaps(node.box, box))
+    continue;
+
+   if (node.count > 0)
+   {
+    for (uint32_t i = node.first; i < node.first + node.count; ++i)
+    {
+     if (overlaps(m_boxes[m_order[i]], box))
+      return true;
+    }
+   }
+   else
+   {
+    stack.push_back(node.left);
+    stack.push_back(node.right);
+   }
+  }
+  return false;
+ }
+
+private:
+ struct Node
+ {
+  Aabb box;
+  uint32_t left = 0;
+  uint32_t right = 0;
+  uint32_t first = 0;
+  uint32_t count = 0;
+ };
+
+ // Builds the node for the boxes in [first, last), splitting them at the median
+ // of their centers along the longest axis of the node.
+ uint32_t buildNode(uint32_t first, uint32_t last)
+ {
+  uint32_t nodeIndex = static_cast<uint32_t>(m_nodes.size());
+  m_nodes.push_back(Node());
+
+  Aabb nodeBox = m_boxes[m_order[first]];
+  for (uint32_t i = first + 1; i < last; ++i)
+  {
+   const Aabb& box = m_boxes[m_order[i]];
+   for (int a = 0; a < 3; ++a)
+   {
+    nodeBox.min[a] = std::min(nodeBox.min[a], box.min[a]);
+    nodeBox.max[a] = std::max(nodeBox.max[a], box.max[a]);
+   }
+  }
+  m_nodes[nodeIndex].box = nodeBox;
+
+  const uint32_t leafSize = 4;
+  if (last - first <= leafSize)
+  {
+   m_nodes[nodeIndex].first = first;
+   m_nodes[nodeIndex].count = last - first;
+   return nodeIndex;
+  }
+
+  int axis = 0;
+  for (int a = 1; a < 3; ++a)
+  {
+   if (nodeBox.max[a] - nodeBox.min[a] > nodeBox.max[axis] - nodeBox.min[axis])
+    axis = a;
+  }
+
+  uint32_t middle = first + (last - first) / 2;
+  std::nth_element(m_order.begin() + first, m_order.begin() + middle, m_order.begin() + last,
+   [&](uint32_t a, uint32_t b) { return m_boxes[a].min[axis] + m_boxes[a].max[axis] < m_boxes[b].min[axis] + m_boxes[b].max[axis]; });
+
+  uint32_t left = buildNode(first, middle);
+  uint32_t right = buildNode(middle, last);
+  m_nodes[nodeIndex].left = left;
+  m_nodes[nodeIndex].right = right;
+  return nodeIndex;
+ }
+
+ std::vector<Aabb> m_boxes;
+ std::vector<uint32_t> m_order;
+ std::vector<Node> m_nodes;
+};
+
+// Returns true if the occurrence is the ancestor occurrence or one of its children,
+// at any depth.
+bool isOccurrenceOrDescendant(const Ptr<Occurrence>& occ, const Ptr<Occurrence>& ancestor)
+{
+ for (Ptr<Occurrence> current = occ; current; current = current->assemblyContext())
+ {
+  if (current == ancestor)
+   return true;
+ }
+ return false;
+}
+
+// Adds the bodies of the occurrence and of all its child occurrences.
+bool addOccurrenceBodies(const Ptr<Occurrence>& occ, std::vector< Ptr<BRepBody> >& bodies)
+{
+ if (!occ)
+  return false;
+ Ptr<BRepBodies> occBodies = occ->bRepBodies();
+ if (!occBodies)
+  return false;
+ for (size_t i = 0; i < occBodies->count(); ++i)
+  bodies.push_back(occBodies->item(i));
+
+ Ptr<OccurrenceList> childOccs = occ->childOccurrences();
+ if (!childOccs)
+  return false;
+ for (size_t i = 0; i < childOccs->count(); ++i)
+ {
+  if (!addOccurrenceBodies(childOccs->item(i), bodies))
+   return false;
+ }
+ return true;
+}
+
+// State of the moving occurrences at one step of a joint sweep.
+struct JointSweepSample
+{
+ double value = 0.0;
+ // 16 values in row major order per moving occurrence.
+ std::vector<double> transforms;
+ bool isColliding = false;
+};
+
+struct JointSweepResult
+{
+ std::vector<JointSweepSample> samples;
+ // Joint value ranges where the moving bodies collide with the static bodies.
+ std::vector<std::pair<double, double>> collidingIntervals;
+ bool isStoppedAtCollision = false;
+};
+
+// Steps a revolute or slider joint through its limits and checks, at each step,
+// the bounding boxes of the moving bodies against those of the static bodies.
+// The static scene hierarchy is built once and reused by all the sweeps.
+class JointMotionStudy
+{
+public:
+ // Sets the bodies that do not move during the sweeps and builds their hierarchy.
+ bool setStaticBodies(const std::vector< Ptr<BRepBody> >& bodies)
+ {
+  std::vector<Aabb> boxes;
+  boxes.reserve(bodies.size());
+  for (const Ptr<BRepBody>& body : bodies)
+  {
+   Aabb box;
+   if (!getBodyBoundingBox(body, box))
+    return false;
+   boxes.push_back(box);
+  }
+  m_staticScene.build(boxes);
+  return true;
+ }
+
+ bool sweep(const Ptr<Joint>& joint, const std::vector< Ptr<Occurrence> >& movingOccurrences,
+  size_t stepCount, bool stopAtFirstCollision, JointSweepResult& result)
+ {
+  result = JointSweepResult();
+  if (!joint || stepCount < 2)
+   return false;
+
+  double minValue = 0.0, maxValue = 0.0, initialValue = 0.0;
+  if (!getJointRange(joint, minValue, maxValue, initialValue))
+   return false;
+
+  // The child occurrences move with their parent.
+  std::vector< Ptr<BRepBody> > movingBodies;
+  for (const Ptr<Occurrence>& occ : movingOccurrences)
+  {
+   if (!addOccurrenceBodies(occ, movingBodies))
+    return false;
+  }
+
+  result.samples.reserve(stepCount);
+  bool isSuccess = true;
+  for (size_t step = 0; step < stepCount; ++step)
+  {
+   JointSweepSample sample;
+   sample.value = minValue + (maxValue - minValue) * step / (stepCount - 1);
+   if (!setJointValue(joint, sample.value))
+   {
+    isSuccess = false;
+    break;
+   }
+
+   // Record the world transforms of the moving occurrences.
+   sample.transforms.reserve(movingOccurrences.size() * 16);
+   for (const Ptr<Occurrence>& occ : movingOccurrences)
+   {
+    Ptr<Matrix3D> transform = occ->transform();
+    if (!transform)
+     continue;
+    std::vector<double> values = transform->asArray();
+    sample.transforms.insert(sample.transforms.end(), values.begin(), values.end());
+   }
+
+   for (const Ptr<BRepBody>& body : movingBodies)
+   {
+    Aabb box;
+    if (getBodyBoundingBox(body, box) && m_staticScene.overlapsAny(box))
+    {
+     sample.isColliding = true;
+     break;
+    }
+   }
+
+   if (sample.isColliding)
+   {
+    bool isNewInterval = result.samples.empty() || !result.samples.back().isColliding;
+    if (isNewInterval)
+     result.collidingIntervals.push_back(std::make_pair(sample.value, sample.value));
+    else
+     result.collidingIntervals.back().second = sample.value;
+   }
+
+   result.samples.push_back(sample);
+   if (sample.isColliding && stopAtFirstCollision)
+   {
+    result.isStoppedAtCollision = true;
+    break;
+   }
+  }
+
+  // Put the joint back where it was.
+  setJointValue(joint, initialValue);
+  return isSuccess;
+ }
+
+ const StaticSceneBvh& staticScene() const { return m_staticScene; }
+
+ // Sets the travel, in cm, swept by a slider joint without limits.
+ void setSlideTravel(double slideTravel) { m_slideTravel = slideTravel; }
+
+private:
+ // Gets the range of the joint value from its limits. Without limits the range is a
+ // full turn, or the slide travel, centered on the current value. With a single
+ // limit it is a full turn, or the slide travel, starting or ending at that limit.
+ bool getJointRange(const Ptr<Joint>& joint, double& minValue, double& maxValue, double& currentValue) const
+ {
+  const double twoPi = 6.28318530717958647692;
+  double span = 0.0;
+  Ptr<JointLimits> limits;
+  if (Ptr<RevoluteJointMotion> revoluteMotion = joint->jointMotion())
+  {
+   currentValue = revoluteMotion->rotationValue();
+   span = twoPi;
+   limits = revoluteMotion->rotationLimits();
+  }
+  else if (Ptr<SliderJointMotion> sliderMotion = joint->jointMotion())
+  {
+   currentValue = sliderMotion->slideValue();
+   span = m_slideTravel;
+   limits = sliderMotion->slideLimits();
+  }
+  else
+   return false;
+
+  bool isMinimumEnabled = limits && limits->isMinimumValueEnabled();
+  bool isMaximumEnabled = limits && limits->isMaximumValueEnabled();
+  minValue = isMinimumEnabled ? limits->minimumValue() : currentValue - span / 2;
+  maxValue = isMaximumEnabled ? limits->maximumValue() : currentValue + span / 2;
+  if (isMinimumEnabled && !isMaximumEnabled)
+   maxValue = minValue + span;
+  else if (isMaximumEnabled && !isMinimumEnabled)
+   minValue = maxValue - span;
+  return maxValue > minValue;
+ }
+
+ static bool setJointValue(const Ptr<Joint>& joint, double value)
+ {
+  if (Ptr<RevoluteJointMotion> revoluteMotion = joint->jointMotion())
+   return revoluteMotion->rotationValue(value);
+  if (Ptr<SliderJointMotion> sliderMotion = joint->jointMotion())
+   return sliderMotion->slideValue(value);
+  return false;
+ }
+
+ StaticSceneBvh m_staticScene;
+ double m_slideTravel = 10.0;
+};
+
 extern "C" XI_EXPORT bool run(const char* context)
 {
  Ptr<Application> app = Application::get();
@@ -181,6 +539,134 @@ extern "C" XI_EXPORT bool run(const char* context)
  limits->isMaximumValueEnabled(true);
  limits->maximumValue(3.14 / 3 * 2);
 
+ // Find how far the cylinder reaches from the sketch plane at mid travel and at the
+ // maximum limit. The cylinder crosses the plane during the sweep, so it only reaches
+ // further on the side it swings into at the end of the sweep.
+ Ptr<Occurrence> movingOcc = joint->occurrenceOne();
+ if(!movingOcc)
+  return false;
+ std::vector< Ptr<BRepBody> > cylinderBodies;
+ if(!addOccurrenceBodies(movingOcc, cylinderBodies) || cylinderBodies.empty())
+  return false;
+ double restRotation = revoluteMotion->rotationValue();
+ Aabb midBox, endBox;
+ revoluteMotion->rotationValue((limits->minimumValue() + limits->maximumValue()) / 2);
+ if(!getBodyBoundingBox(cylinderBodies[0], midBox))
+  return false;
+ revoluteMotion->rotationValue(limits->maximumValue());
+ if(!getBodyBoundingBox(cylinderBodies[0], endBox))
+  return false;
+ revoluteMotion->rotationValue(restRotation);
+
+ // Add a 2 cm thick block that does not move on that side, starting halfway between
+ // the two reaches, so that only the end of the sweep runs into it.
+ bool isAbove = endBox.max[1] - midBox.max[1] > midBox.min[1] - endBox.min[1];
+ double nearY = isAbove ? (midBox.max[1] + endBox.max[1]) / 2 : (midBox.min[1] + endBox.min[1]) / 2;
+ double farY = isAbove ? nearY + 2.0 : nearY - 2.0;
+
+ // The block is extruded along the normal of the xz plane, from the face it points away from.
+ Ptr<Plane> xzGeometry = xz->geometry();
+ if(!xzGeometry)
+  return false;
+ Ptr<Vector3D> xzNormal = xzGeometry->normal();
+ if(!xzNormal)
+  return false;
+ double normalY = xzNormal->y() > 0 ? 1.0 : -1.0;
+ double blockStartY = normalY > 0 ? std::min(nearY, farY) : std::max(nearY, farY);
+
+ Ptr<ConstructionPlanes> ctorPlanes = rootComp->constructionPlanes();
+ if(!ctorPlanes)
+  return false;
+ Ptr<ConstructionPlaneInput> ctorPlaneInput = ctorPlanes->createInput();
+ if(!ctorPlaneInput)
+  return false;
+ ctorPlaneInput->setByOffset(xz, ValueInput::createByReal(blockStartY * normalY));
+ Ptr<ConstructionPlane> blockPlane = ctorPlanes->add(ctorPlaneInput);
+ if(!blockPlane)
+  return false;
+ Ptr<Sketch> blockSketch = sketches->add(blockPlane);
+ if(!blockSketch)
+  return false;
+ Ptr<SketchLines> blockLines = blockSketch->sketchCurves()->sketchLines();
+ if(!blockLines)
+  return false;
+ Ptr<Point3D> blockCorner0 = blockSketch->modelToSketchSpace(Point3D::create(endBox.min[0], blockStartY, endBox.min[2]));
+ Ptr<Point3D> blockCorner1 = blockSketch->modelToSketchSpace(Point3D::create(endBox.max[0], blockStartY, endBox.max[2]));
+ if(!blockCorner0 || !blockCorner1)
+  return false;
+ blockLines->addTwoPointRectangle(blockCorner0, blockCorner1);
+ Ptr<Profile> blockProf = blockSketch->profiles()->item(0);
+ if(!blockProf)
+  return false;
+ Ptr<ExtrudeFeatureInput> blockExtInput = extrudes->createInput(blockProf, FeatureOperations::NewBodyFeatureOperation);
+ if(!blockExtInput)
+  return false;
+ blockExtInput->setDistanceExtent(false, ValueInput::createByReal(2.0));
+ blockExtInput->isSolid(true);
+ Ptr<ExtrudeFeature> blockExt = extrudes->add(blockExtInput);
+ if(!blockExt)
+  return false;
+
+ // Sweep the joint through its limits and check the moving bodies, and those of its
+ // child occurrences, against the other bodies.
+ std::vector< Ptr<Occurrence> > movingOccurrences(1, movingOcc);
+
+ std::vector< Ptr<BRepBody> > staticBodies;
+ Ptr<BRepBodies> rootBodies = rootComp->bRepBodies();
+ if(!rootBodies)
+  return false;
+ for (size_t i = 0; i < rootBodies->count(); ++i)
+  staticBodies.push_back(rootBodies->item(i));
+ Ptr<OccurrenceList> allOccs = rootComp->allOccurrences();
+ if(!allOccs)
+  return false;
+ for (size_t i = 0; i < allOccs->count(); ++i) {
+  Ptr<Occurrence> occ = allOccs->item(i);
+  if(!occ || isOccurrenceOrDescendant(occ, movingOcc))
+   continue;
+  Ptr<BRepBodies> occBodies = occ->bRepBodies();
+  if(!occBodies)
+   continue;
+  for (size_t j = 0; j < occBodies->count(); ++j)
+   staticBodies.push_back(occBodies->item(j));
+ }
+
+ JointMotionStudy motionStudy;
+ if(!motionStudy.setStaticBodies(staticBodies))
+  return false;
+ JointSweepResult sweepResult;
+ if(!motionStudy.sweep(joint, movingOccurrences, 61, false, sweepResult))
+  return false;
+
+ // Sweep again, this time stopping at the first step that collides.
+ JointSweepResult stoppedResult;
+ if(!motionStudy.sweep(joint, movingOccurrences, 61, true, stoppedResult))
+  return false;
+
+ // Report the joint angles where the bounding boxes collide.
+ const double degreesPerRadian = 180.0 / 3.14159265358979323846;
+ size_t collidingSampleCount = 0;
+ for (const JointSweepSample& sample : sweepResult.samples)
+ {
+  if (sample.isColliding)
+   ++collidingSampleCount;
+ }
+ std::stringstream message;
+ message << "Swept " << sweepResult.samples.size() << " steps against " << motionStudy.staticScene().boxCount() << " static bodies.\n";
+ message << collidingSampleCount << " steps collide";
+ if (!sweepResult.collidingIntervals.empty())
+ {
+  message << ", between:";
+  for (const std::pair<double, double>& interval : sweepResult.collidingIntervals)
+   message << "\n  " << interval.first * degreesPerRadian << " deg and " << interval.second * degreesPerRadian << " deg";
+ }
+ else
+  message << ".";
+ if (stoppedResult.isStoppedAtCollision)
+  message << "\nStopping at the first collision, the sweep stops at " << stoppedResult.samples.back().value * degreesPerRadian
+   << " deg after " << stoppedResult.samples.size() << " steps.";
+ ui->messageBox(message.str());
+
  return true;
 }
 
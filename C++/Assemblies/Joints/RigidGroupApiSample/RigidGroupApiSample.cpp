@@ -15,10 +15,16 @@
 #include <Fusion/Construction/ConstructionPlaneInput.h>
 #include <Fusion/Construction/ConstructionPlane.h>
 #include <Fusion/Components/Component.h>
+#include <Fusion/Components/AsBuiltJoint.h>
+#include <Fusion/Components/AsBuiltJoints.h>
+#include <Fusion/Components/Joint.h>
+#include <Fusion/Components/JointMotion.h>
+#include <Fusion/Components/Joints.h>
 #include <Fusion/Components/RigidGroups.h>
 #include <Fusion/Components/RigidGroup.h>
 #include <Fusion/Components/Occurrence.h>
 #include <Fusion/Components/Occurrences.h>
+#include <Fusion/Components/OccurrenceList.h>
 #include <Fusion/Features/Features.h>
 #include <Fusion/Features/ExtrudeFeature.h>
 #include <Fusion/Features/ExtrudeFeatures.h>
@@ -31,6 +37,13 @@
 #include <Fusion/Sketch/SketchCircles.h>
 #include <Fusion/Sketch/SketchCurves.h>
 
+#include <algorithm>
+#include <map>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
 using namespace adsk::core;
 using namespace adsk::fusion;
 
@@ -99,6 +112,293 @@ bool CreateCylinder(Ptr<Occurrence> occ, double diameter, double height, bool is
  return true;
 }
 
+// Union-find over the rows of a table, with union by size and path halving.
+class DisjointSets
+{
+public:
+ explicit DisjointSets(size_t count) : m_parents(count), m_sizes(count, 1)
+ {
+  for (size_t i = 0; i < count; ++i)
+   m_parents[i] = i;
+ }
+
+ size_t find(size_t row)
+ {
+  while (m_parents[row] != row)
+  {
+   m_parents[row] = m_parents[m_parents[row]];
+   row = m_parents[row];
+  }
+  return row;
+ }
+
+ void unite(size_t rowOne, size_t rowTwo)
+ {
+  rowOne = find(rowOne);
+  rowTwo = find(rowTwo);
+  if (rowOne == rowTwo)
+   return;
+  if (m_sizes[rowOne] < m_sizes[rowTwo])
+   std::swap(rowOne, rowTwo);
+  m_parents[rowTwo] = rowOne;
+  m_sizes[rowOne] += m_sizes[rowTwo];
+ }
+
+private:
+ std::vector<size_t> m_parents;
+ std::vector<size_t> m_sizes;
+};
+
+// Number of degrees of freedom a joint of the given type leaves between its two occurrences.
+int getJointDegreesOfFreedom(JointTypes jointType)
+{
+ switch (jointType)
+ {
+ case JointTypes::RigidJointType:
+  return 0;
+ case JointTypes::RevoluteJointType:
+ case JointTypes::SliderJointType:
+  return 1;
+ case JointTypes::CylindricalJointType:
+ case JointTypes::PinSlotJointType:
+  return 2;
+ case JointTypes::PlanarJointType:
+ case JointTypes::BallJointType:
+  return 3;
+ default:
+  return 6;
+ }
+}
+
+// Island index of occurrences that are not part of the assembly.
+const size_t noKinematicIsland = static_cast<size_t>(-1);
+
+// A set of occurrences connected by joints, as-built joints, rigid groups or grounding.
+// Moving any occurrence of an island can only move occurrences of the same island.
+struct KinematicIsland
+{
+ std::vector<size_t> occurrenceRows;
+ // Number of rigid clusters, not counting the ground, that move independently.
+ size_t bodyCount = 0;
+ // Number of non-rigid joints between the occurrences of the island.
+ size_t jointCount = 0;
+ // Estimated as 6 per body minus the constraints of each joint; redundant constraints are not detected.
+ int degreesOfFreedom = 0;
+ bool isGrounded = false;
+};
+
+// Splits the occurrences of an assembly into kinematic islands. Rigid connections
+// (rigid joints, rigid groups, grounding and nesting in a parent occurrence) are first
+// merged into bodies, then every connection is merged into islands, each in one
+// pass over the joints with a union-find.
+class KinematicIslands
+{
+public:
+ bool build(const Ptr<Component>& rootComp)
+ {
+  m_occurrences.clear();
+  m_islands.clear();
+  m_islandOfOccurrence.clear();
+  m_unconstrainedGroundedRows.clear();
+  m_rowOfPath.clear();
+  if (!rootComp)
+   return false;
+
+  Ptr<OccurrenceList> allOccs = rootComp->allOccurrences();
+  if (!allOccs)
+   return false;
+  for (size_t i = 0; i < allOccs->count(); ++i)
+  {
+   Ptr<Occurrence> occ = allOccs->item(i);
+   if (!occ)
+    return false;
+   m_rowOfPath[occ->fullPathName()] = m_occurrences.size();
+   m_occurrences.push_back(occ);
+  }
+
+  // The last row stands for the ground, which joints to the root component attach to.
+  size_t groundRow = m_occurrences.size();
+  DisjointSets bodies(groundRow + 1);
+  DisjointSets islands(groundRow + 1);
+  std::vector<bool> isConstrained(groundRow, false);
+  std::vector<std::pair<size_t, size_t> > jointRows;
+  std::vector<int> jointDegreesOfFreedom;
+
+  for (size_t row = 0; row < groundRow; ++row)
+  {
+   // A nested occurrence moves with its parent occurrence.
+   std::string path = m_occurrences[row]->fullPathName();
+   size_t separator = path.rfind('+');
+   if (separator != std::string::npos)
+   {
+    std::map<std::string, size_t>::const_iterator parent = m_rowOfPath.find(path.substr(0, separator));
+    if (parent != m_rowOfPath.end())
+    {
+     bodies.unite(row, parent->second);
+     islands.unite(row, parent->second);
+    }
+   }
+   if (m_occurrences[row]->isGrounded())
+   {
+    bodies.unite(row, groundRow);
+    islands.unite(row, groundRow);
+   }
+  }
+
+  Ptr<Joints> joints = rootComp->joints();
+  if (!joints)
+   return false;
+  for (size_t i = 0; i < joints->count(); ++i)
+  {
+   Ptr<Joint> joint = joints->item(i);
+   if (!joint || joint->isSuppressed())
+    continue;
+   Ptr<JointMotion> jointMotion = joint->jointMotion();
+   if (!jointMotion)
+    continue;
+   addJoint(getRow(joint->occurrenceOne(), groundRow), getRow(joint->occurrenceTwo(), groundRow),
+    getJointDegreesOfFreedom(jointMotion->jointType()), bodies, islands, isConstrained, jointRows, jointDegreesOfFreedom);
+  }
+
+  Ptr<AsBuiltJoints> asBuiltJoints = rootComp->asBuiltJoints();
+  if (!asBuiltJoints)
+   return false;
+  for (size_t i = 0; i < asBuiltJoints->count(); ++i)
+  {
+   Ptr<AsBuiltJoint> asBuiltJoint = asBuiltJoints->item(i);
+   if (!asBuiltJoint || asBuiltJoint->isSuppressed())
+    continue;
+   Ptr<JointMotion> jointMotion = asBuiltJoint->jointMotion();
+   if (!jointMotion)
+    continue;
+   addJoint(getRow(asBuiltJoint->occurrenceOne(), groundRow), getRow(asBuiltJoint->occurrenceTwo(), groundRow),
+    getJointDegreesOfFreedom(jointMotion->jointType()), bodies, islands, isConstrained, jointRows, jointDegreesOfFreedom);
+  }
+
+  Ptr<RigidGroups> rigidGroups = rootComp->rigidGroups();
+  if (!rigidGroups)
+   return false;
+  for (size_t i = 0; i < rigidGroups->count(); ++i)
+  {
+   Ptr<RigidGroup> rigidGroup = rigidGroups->item(i);
+   if (!rigidGroup || rigidGroup->isSuppressed())
+    continue;
+   Ptr<OccurrenceList> groupOccs = rigidGroup->occurrences();
+   if (!groupOccs || groupOccs->count() == 0)
+    continue;
+   size_t firstRow = getRow(groupOccs->item(0), groundRow);
+   for (size_t j = 0; j < groupOccs->count(); ++j)
+   {
+    size_t row = getRow(groupOccs->item(j), groundRow);
+    addJoint(firstRow, row, 0, bodies, islands, isConstrained, jointRows, jointDegreesOfFreedom);
+   }
+  }
+
+  // Number the islands in the order of their first occurrence.
+  std::vector<size_t> islandOfRoot(groundRow + 1, noKinematicIsland);
+  m_islandOfOccurrence.resize(groundRow);
+  for (size_t row = 0; row < groundRow; ++row)
+  {
+   size_t root = islands.find(row);
+   if (islandOfRoot[root] == noKinematicIsland)
+   {
+    islandOfRoot[root] = m_islands.size();
+    m_islands.push_back(KinematicIsland());
+   }
+   m_islandOfOccurrence[row] = islandOfRoot[root];
+   m_islands[islandOfRoot[root]].occurrenceRows.push_back(row);
+  }
+  size_t groundIsland = islandOfRoot[islands.find(groundRow)];
+  if (groundIsland != noKinematicIsland)
+   m_islands[groundIsland].isGrounded = true;
+
+  // Count the bodies of each island, the ground excepted.
+  std::vector<bool> isBodyCounted(groundRow + 1, false);
+  isBodyCounted[bodies.find(groundRow)] = true;
+  for (size_t row = 0; row < groundRow; ++row)
+  {
+   size_t body = bodies.find(row);
+   if (!isBodyCounted[body])
+   {
+    isBodyCounted[body] = true;
+    ++m_islands[m_islandOfOccurrence[row]].bodyCount;
+   }
+  }
+
+  for (size_t i = 0; i < jointRows.size(); ++i)
+  {
+   // Joints between occurrences of the same body add no constraint.
+   if (bodies.find(jointRows[i].first) == bodies.find(jointRows[i].second))
+    continue;
+   size_t row = jointRows[i].first != groundRow ? jointRows[i].first : jointRows[i].second;
+   KinematicIsland& island = m_islands[m_islandOfOccurrence[row]];
+   ++island.jointCount;
+   island.degreesOfFreedom -= 6 - jointDegreesOfFreedom[i];
+  }
+
+  for (size_t i = 0; i < m_islands.size(); ++i)
+   m_islands[i].degreesOfFreedom = std::max(0, m_islands[i].degreesOfFreedom + 6 * static_cast<int>(m_islands[i].bodyCount));
+
+  for (size_t row = 0; row < groundRow; ++row)
+  {
+   if (m_occurrences[row]->isGrounded() && !isConstrained[row])
+    m_unconstrainedGroundedRows.push_back(row);
+  }
+  return true;
+ }
+
+ const std::vector<KinematicIsland>& islands() const { return m_islands; }
+ Ptr<Occurrence> occurrence(size_t row) const { return m_occurrences[row]; }
+
+ // Gets the index of the island of the occurrence, or noKinematicIsland if it is not part of the assembly.
+ size_t islandOf(const Ptr<Occurrence>& occ) const
+ {
+  if (!occ)
+   return noKinematicIsland;
+  std::map<std::string, size_t>::const_iterator found = m_rowOfPath.find(occ->fullPathName());
+  return found != m_rowOfPath.end() ? m_islandOfOccurrence[found->second] : noKinematicIsland;
+ }
+
+ // Grounded occurrences that no joint or rigid group refers to.
+ const std::vector<size_t>& unconstrainedGroundedRows() const { return m_unconstrainedGroundedRows; }
+
+private:
+ // Gets the row of the occurrence, the ground row standing for the root component.
+ size_t getRow(const Ptr<Occurrence>& occ, size_t groundRow) const
+ {
+  if (!occ)
+   return groundRow;
+  std::map<std::string, size_t>::const_iterator found = m_rowOfPath.find(occ->fullPathName());
+  return found != m_rowOfPath.end() ? found->second : groundRow;
+ }
+
+ static void addJoint(size_t rowOne, size_t rowTwo, int degreesOfFreedom, DisjointSets& bodies, DisjointSets& islands,
+  std::vector<bool>& isConstrained, std::vector<std::pair<size_t, size_t> >& jointRows, std::vector<int>& jointDegreesOfFreedom)
+ {
+  if (rowOne < isConstrained.size())
+   isConstrained[rowOne] = true;
+  if (rowTwo < isConstrained.size())
+   isConstrained[rowTwo] = true;
+  if (rowOne == rowTwo)
+   return;
+
+  islands.unite(rowOne, rowTwo);
+  if (degreesOfFreedom == 0)
+   bodies.unite(rowOne, rowTwo);
+  else
+  {
+   jointRows.push_back(std::make_pair(rowOne, rowTwo));
+   jointDegreesOfFreedom.push_back(degreesOfFreedom);
+  }
+ }
+
+ std::vector< Ptr<Occurrence> > m_occurrences;
+ std::map<std::string, size_t> m_rowOfPath;
+ std::vector<size_t> m_islandOfOccurrence;
+ std::vector<KinematicIsland> m_islands;
+ std::vector<size_t> m_unconstrainedGroundedRows;
+};
+
 extern "C" XI_EXPORT bool run(const char* context)
 {
  app = Application::get();
@@ -218,6 +518,23 @@ extern "C" XI_EXPORT bool run(const char* context)
  if(!rigidGroup)
   return false;
 
+ // Report the kinematic islands of the assembly
+ KinematicIslands kinematicIslands;
+ if(!kinematicIslands.build(rootComp))
+  return false;
+ std::stringstream report;
+ const std::vector<KinematicIsland>& islands = kinematicIslands.islands();
+ for (size_t i = 0; i < islands.size(); ++i)
+ {
+  report << "Island " << i + 1 << ": " << islands[i].occurrenceRows.size() << " occurrences, " << islands[i].bodyCount << " bodies, "
+   << islands[i].jointCount << " joints, " << islands[i].degreesOfFreedom << " degrees of freedom"
+   << (islands[i].isGrounded ? ", grounded" : "") << "\n";
+ }
+ const std::vector<size_t>& unconstrainedRows = kinematicIslands.unconstrainedGroundedRows();
+ for (size_t i = 0; i < unconstrainedRows.size(); ++i)
+  report << "Grounded but unconstrained: " << kinematicIslands.occurrence(unconstrainedRows[i])->name() << "\n";
+ ui->messageBox(report.str());
+
  // Fit to window
  Ptr<Viewport> viewPort = app->activeViewport();
  if(!viewPort)
@@ -12,36 +12,268 @@
 #include <Fusion/Components/OccurrenceList.h>
 #include <Fusion/Fusion/Design.h>
 
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#ifndef XI_WIN
+#include <dlfcn.h>
+#endif
+
 using namespace adsk::core;
 using namespace adsk::fusion;
 
 Ptr<UserInterface> ui;
 
-// Returns a string containing the especified number of spaces.
-std::string spaces(size_t spaceCount) {
- std::string result = "";
- for (size_t i = 0; i < spaceCount; ++i) {
-  result += " ";
+std::string getDllPath();
+
+// Multiplies two 4x4 matrices stored as 16 doubles in row major order: result = a * b.
+inline void multiplyMatrices(const double* a, const double* b, double* result) {
+ for (int row = 0; row < 4; ++row) {
+  const double* aRow = a + row * 4;
+  for (int col = 0; col < 4; ++col)
+   result[row * 4 + col] = aRow[0] * b[col] + aRow[1] * b[4 + col] + aRow[2] * b[8 + col] + aRow[3] * b[12 + col];
  }
- return result;
 }
 
-// Performs a recursive traversal of an entire assembly structure.
-std::string traverseAssembly(Ptr<OccurrenceList> occurrences, size_t currentLevel, std::string inputString) {
- if(occurrences) {
-  for (size_t i = 0; i < occurrences->count(); ++i) {
-   Ptr<Occurrence> occ = occurrences->item(i);
-   if(occ) {
-    inputString += spaces(currentLevel * 5) + occ->name() + "\n";
-
-    if (occ->childOccurrences()) {
-     inputString = traverseAssembly(occ->childOccurrences(), currentLevel + 1, inputString);
-    }
+// Caches the world transform of every occurrence of an assembly in flat arrays
+// indexed by traversal order. The local transforms are read once and the world
+// transforms are computed top-down, each one from the already computed world
+// transform of its parent. The cache is a snapshot: build it again after the
+// occurrences move.
+class OccurrenceTransformCache
+{
+public:
+ static const uint32_t noParent = 0xFFFFFFFF;
+
+ bool build(Ptr<OccurrenceList> occurrences) {
+  m_occurrences.clear();
+  m_parents.clear();
+  m_localTransforms.clear();
+  m_worldTransforms.clear();
+  if (!occurrences)
+   return false;
+
+  struct Frame {
+   Ptr<OccurrenceList> occurrences;
+   size_t count;
+   size_t next;
+   uint32_t parentRow;
+  };
+
+  std::vector<Frame> stack;
+  stack.push_back({ occurrences, occurrences->count(), 0, noParent });
+  while (!stack.empty()) {
+   Frame& frame = stack.back();
+   if (frame.next >= frame.count) {
+    stack.pop_back();
+    continue;
    }
+
+   Ptr<Occurrence> occ = frame.occurrences->item(frame.next++);
+   if (!occ)
+    continue;
+
+   uint32_t row = static_cast<uint32_t>(m_occurrences.size());
+   m_occurrences.push_back(occ);
+   m_parents.push_back(frame.parentRow);
+   m_localTransforms.resize(m_localTransforms.size() + 16);
+   if (!readLocalTransform(row))
+    return false;
+
+   Ptr<OccurrenceList> children = occ->childOccurrences();
+   if (children && children->count() > 0)
+    stack.push_back({ children, children->count(), 0, row });
   }
+
+  m_worldTransforms.resize(m_localTransforms.size());
+  computeWorldTransforms(0, static_cast<uint32_t>(m_occurrences.size()));
+  return true;
  }
 
- return inputString;
+ size_t size() const { return m_occurrences.size(); }
+ Ptr<Occurrence> occurrence(uint32_t row) const { return m_occurrences[row]; }
+ uint32_t parent(uint32_t row) const { return m_parents[row]; }
+
+ // Returns the 16 values, in row major order, of the world transform of the row.
+ const double* worldTransform(uint32_t row) const { return &m_worldTransforms[row * 16]; }
+
+ Ptr<Matrix3D> worldMatrix(uint32_t row) const {
+  Ptr<Matrix3D> matrix = Matrix3D::create();
+  if (!matrix)
+   return nullptr;
+  const double* values = worldTransform(row);
+  matrix->setWithArray(std::vector<double>(values, values + 16));
+  return matrix;
+ }
+
+private:
+ // The transform of an occurrence is relative to its parent component.
+ bool readLocalTransform(uint32_t row) {
+  Ptr<Matrix3D> transform = m_occurrences[row]->transform();
+  if (!transform)
+   return false;
+  std::vector<double> values = transform->asArray();
+  if (values.size() != 16)
+   return false;
+  std::copy(values.begin(), values.end(), m_localTransforms.begin() + row * 16);
+  return true;
+ }
+
+ // Rows are in depth first order, so a parent is always computed before its children.
+ void computeWorldTransforms(uint32_t firstRow, uint32_t endRow) {
+  for (uint32_t row = firstRow; row < endRow; ++row) {
+   const double* local = &m_localTransforms[row * 16];
+   double* world = &m_worldTransforms[row * 16];
+   uint32_t parentRow = m_parents[row];
+   if (parentRow == noParent)
+    std::copy(local, local + 16, world);
+   else
+    multiplyMatrices(&m_worldTransforms[parentRow * 16], local, world);
+  }
+ }
+
+ std::vector<Ptr<Occurrence>> m_occurrences;
+ std::vector<uint32_t> m_parents;
+ std::vector<double> m_localTransforms;
+ std::vector<double> m_worldTransforms;
+};
+
+// Buffers the rows of the assembly report and writes them to a text stream and to
+// a binary table stream. The binary table starts with the "ASMT" tag and a version,
+// followed by one record per row: level (uint32), parent row (uint32, 0xFFFFFFFF
+// for none), world position (3 doubles, zero for none), name length (uint32) and
+// the name bytes.
+class AssemblyReportWriter
+{
+public:
+ static const uint32_t noParent = 0xFFFFFFFF;
+
+ AssemblyReportWriter(std::ostream* textStream, std::ostream* binaryStream, size_t bufferSize = 1 << 16)
+  : m_textStream(textStream), m_binaryStream(binaryStream), m_bufferSize(bufferSize)
+ {
+  m_textBuffer.reserve(m_bufferSize);
+  m_binaryBuffer.reserve(m_bufferSize);
+
+  const char tag[4] = { 'A', 'S', 'M', 'T' };
+  uint32_t version = 2;
+  m_binaryBuffer.append(tag, sizeof(tag));
+  appendBinary(version);
+ }
+
+ ~AssemblyReportWriter()
+ {
+  flush();
+ }
+
+ // Writes one row and returns its index. The world transform, if any, is 16 values in
+ // row major order, and the row shows its translation.
+ uint32_t writeRow(size_t level, uint32_t parentRow, const std::string& name, const double* worldTransform = nullptr)
+ {
+  double position[3] = { 0.0, 0.0, 0.0 };
+  if (worldTransform) {
+   position[0] = worldTransform[3];
+   position[1] = worldTransform[7];
+   position[2] = worldTransform[11];
+  }
+
+  if (m_textStream) {
+   m_textBuffer.append(level * 5, ' ');
+   m_textBuffer += name;
+   if (worldTransform) {
+    std::ostringstream positionText;
+    positionText << "  at (" << position[0] << ", " << position[1] << ", " << position[2] << ")";
+    m_textBuffer += positionText.str();
+   }
+   m_textBuffer += '\n';
+  }
+
+  if (m_binaryStream) {
+   appendBinary(static_cast<uint32_t>(level));
+   appendBinary(parentRow);
+   m_binaryBuffer.append(reinterpret_cast<const char*>(position), sizeof(position));
+   appendBinary(static_cast<uint32_t>(name.size()));
+   m_binaryBuffer += name;
+  }
+
+  if (m_textBuffer.size() >= m_bufferSize || m_binaryBuffer.size() >= m_bufferSize)
+   flush();
+
+  return m_rowCount++;
+ }
+
+ void flush()
+ {
+  if (m_textStream && !m_textBuffer.empty())
+   m_textStream->write(m_textBuffer.data(), m_textBuffer.size());
+  if (m_binaryStream && !m_binaryBuffer.empty())
+   m_binaryStream->write(m_binaryBuffer.data(), m_binaryBuffer.size());
+  m_textBuffer.clear();
+  m_binaryBuffer.clear();
+ }
+
+ uint32_t rowCount() const { return m_rowCount; }
+
+private:
+ void appendBinary(uint32_t value)
+ {
+  m_binaryBuffer.append(reinterpret_cast<const char*>(&value), sizeof(value));
+ }
+
+ std::ostream* m_textStream;
+ std::ostream* m_binaryStream;
+ size_t m_bufferSize;
+ std::string m_textBuffer;
+ std::string m_binaryBuffer;
+ uint32_t m_rowCount = 0;
+};
+
+// Performs a traversal of an entire assembly structure using an explicit stack
+// instead of recursion, so deep assemblies cannot overflow the call stack. Each
+// occurrence is written as soon as it is visited, in the same depth-first order
+// as a recursive traversal, and nothing is copied per level. A transform cache
+// built from the same occurrences has its rows in that order, so the world
+// transform of the n-th occurrence visited is row n of the cache.
+void traverseAssembly(Ptr<OccurrenceList> occurrences, size_t startLevel, uint32_t parentRow, AssemblyReportWriter& writer,
+ const OccurrenceTransformCache* transformCache = nullptr) {
+ struct Frame {
+  Ptr<OccurrenceList> occurrences;
+  size_t count;
+  size_t next;
+  size_t level;
+  uint32_t parentRow;
+ };
+
+ std::vector<Frame> stack;
+ if (occurrences)
+  stack.push_back({ occurrences, occurrences->count(), 0, startLevel, parentRow });
+
+ uint32_t occurrenceIndex = 0;
+ while (!stack.empty()) {
+  Frame& frame = stack.back();
+  if (frame.next >= frame.count) {
+   stack.pop_back();
+   continue;
+  }
+
+  Ptr<Occurrence> occ = frame.occurrences->item(frame.next++);
+  if (!occ)
+   continue;
+
+  size_t level = frame.level;
+  const double* worldTransform = transformCache && occurrenceIndex < transformCache->size() ? transformCache->worldTransform(occurrenceIndex) : nullptr;
+  ++occurrenceIndex;
+  uint32_t row = writer.writeRow(level, frame.parentRow, occ->name(), worldTransform);
+
+  // The frame reference is not used after this point since push_back may reallocate.
+  Ptr<OccurrenceList> children = occ->childOccurrences();
+  if (children && children->count() > 0)
+   stack.push_back({ children, children->count(), 0, level + 1, row });
+ }
 }
 
 extern "C" XI_EXPORT bool run(const char* context)
@@ -71,17 +303,44 @@ extern "C" XI_EXPORT bool run(const char* context)
  Ptr<Occurrences> occurrences = rootComp->occurrences();
  if(!occurrences)
   return false;
- // Create the title for the output.
- std::string resultString = "Root (" + design->parentDocument()->name() + ")\n";
 
- // Call the recursive function to traverse the assembly and build the output string.
- resultString = traverseAssembly(occurrences->asList(), 1, resultString);
- 
+ // Cache the world transforms of all the occurrences, computed top-down in traversal order.
+ std::chrono::steady_clock::time_point cacheStartTime = std::chrono::steady_clock::now();
+ OccurrenceTransformCache transformCache;
+ if (!transformCache.build(occurrences->asList()))
+  return false;
+ double cacheSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - cacheStartTime).count();
+
+ // Stream the report as text for the TEXT COMMANDS window and as a binary table file,
+ // with the world position of each occurrence taken from the cache.
+ std::ostringstream resultStream;
+ std::ofstream tableFile(getDllPath() + "/" + "AssemblyTraversal.bin", std::ios::binary | std::ios::trunc);
+ uint32_t rowCount = 0;
+ std::chrono::steady_clock::time_point traversalStartTime = std::chrono::steady_clock::now();
+ {
+  AssemblyReportWriter writer(&resultStream, tableFile ? &tableFile : nullptr);
+
+  // Create the title for the output.
+  uint32_t rootRow = writer.writeRow(0, AssemblyReportWriter::noParent, "Root (" + design->parentDocument()->name() + ")");
+
+  // Traverse the assembly and write one row per occurrence.
+  traverseAssembly(occurrences->asList(), 1, rootRow, writer, &transformCache);
+  rowCount = writer.rowCount();
+ }
+ double traversalSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - traversalStartTime).count();
+
+ // Report the time taken, including the writes, so it can be compared between assemblies.
+ size_t occurrenceCount = rowCount > 0 ? rowCount - 1 : 0;
+ resultStream << "Traversed " << occurrenceCount << " occurrences in " << traversalSeconds * 1000 << " ms";
+ if (occurrenceCount > 0)
+  resultStream << " (" << traversalSeconds * 1e6 / occurrenceCount << " us per occurrence)";
+ resultStream << ", after caching their world transforms in " << cacheSeconds * 1000 << " ms\n";
+
      // Write the results to the TEXT COMMANDS window.
      Ptr<TextCommandPalette> textPalette = ui->palettes()->itemById("TextCommands");
      if (!textPalette->isVisible())
          textPalette->isVisible(true);
-     textPalette->writeText(resultString);
+     textPalette->writeText(resultStream.str());
  return true;
 }
 
@@ -103,4 +362,33 @@ BOOL APIENTRY DllMain(HMODULE hmodule, DWORD reason, LPVOID reserved)
  return TRUE;
 }
 
-#endif // XI_WIN
\ No newline at end of file
+#endif // XI_WIN
+
+std::string getDllPath()
+{
+#if defined(_WINDOWS) || defined(_WIN32) || defined(_WIN64)
+ HMODULE hModule = NULL;
+ if (!GetModuleHandleExA(GET_MODULE_HANDLE_EX_FLAG_FROM_ADDRESS |
+  GET_MODULE_HANDLE_EX_FLAG_UNCHANGED_REFCOUNT,
+  (LPCSTR)&getDllPath,
+  &hModule))
+  return "";
+
+ char winTempPath[2048];
+ ::GetModuleFileNameA(hModule, winTempPath, 2048);
+
+ std::string strPath = winTempPath;
+ size_t stPos = strPath.rfind('\\');
+ return strPath.substr(0, stPos);
+#else
+ Dl_info info;
+ dladdr((void*)getDllPath, &info);
+
+ std::string strPath = info.dli_fname;
+ int stPos = (int)strPath.rfind('/');
+ if (stPos != -1)
+  return strPath.substr(0, stPos);
+ else
+  return "";
+#endif
+}
\ No newline at end of file
@@ -10,6 +10,7 @@
 #include <Fusion/BRep/BRepBody.h>
 #include <Fusion/BRep/BRepBodies.h>
 #include <Fusion/Components/Component.h>
+#include <Fusion/Components/Components.h>
 #include <Fusion/Components/Occurrence.h>
 #include <Fusion/Components/OccurrenceList.h>
 #include <Fusion/Construction/ConstructionPlane.h>
@@ -28,11 +29,88 @@
 #include <Fusion/Sketch/SketchLine.h>
 #include <Fusion/Sketch/SketchLines.h>
 
+#include <cmath>
+#include <sstream>
+#include <string>
+#include <vector>
+
 using namespace adsk::core;
 using namespace adsk::fusion;
 
 Ptr<UserInterface> ui;
 
+// Returns the volume of the bodies of a component, optionally ignoring the hidden ones.
+double getBodiesVolume(const Ptr<BRepBodies>& bodies, bool visibleOnly) {
+ double volume = .0;
+ if (!bodies)
+  return volume;
+ for (size_t j = 0; j < bodies->count(); ++j) {
+  Ptr<BRepBody> body = bodies->item(j);
+  if (!body)
+   continue;
+  if (visibleOnly && !body->isLightBulbOn())
+   continue;
+  volume += body->volume();
+ }
+ return volume;
+}
+
+// Totals of a design volume aggregated per unique component.
+struct DesignVolumeTotals {
+ double totalVolume = .0;
+ size_t occurrenceCount = 0;
+ size_t uniqueComponentCount = 0;
+};
+
+// Computes the total volume of a design from its unique components. The volume of each
+// component is computed once and multiplied by the number of its occurrences, so the
+// cost follows the number of components rather than occurrences. When visibleOnly is
+// true, hidden bodies are skipped and only the visible occurrences of a component are
+// counted, which needs one call per occurrence of the components that have a volume.
+bool getDesignVolumeByComponent(const Ptr<Design>& design, bool visibleOnly, DesignVolumeTotals& totals) {
+ totals = DesignVolumeTotals();
+ Ptr<Component> rootComp = design->rootComponent();
+ if (!rootComp)
+  return false;
+ Ptr<Components> comps = design->allComponents();
+ if (!comps)
+  return false;
+
+ for (size_t i = 0; i < comps->count(); ++i) {
+  Ptr<Component> comp = comps->item(i);
+  if (!comp)
+   return false;
+
+  // The root component has no occurrence and is counted once.
+  double componentVolume = getBodiesVolume(comp->bRepBodies(), visibleOnly);
+  if (comp->id() == rootComp->id()) {
+   totals.totalVolume += componentVolume;
+   continue;
+  }
+
+  Ptr<OccurrenceList> occList = rootComp->allOccurrencesByComponent(comp);
+  if (!occList)
+   return false;
+  size_t count = occList->count();
+  if (visibleOnly && componentVolume > 0) {
+   count = 0;
+   for (size_t j = 0; j < occList->count(); ++j) {
+    Ptr<Occurrence> occ = occList->item(j);
+    if (occ && occ->isVisible())
+     ++count;
+   }
+  }
+  if (count == 0)
+   continue;
+
+  totals.totalVolume += componentVolume * count;
+  totals.occurrenceCount += count;
+  ++totals.uniqueComponentCount;
+ }
+
+ return true;
+}
+
 extern "C" XI_EXPORT bool run(const char* context)
 {
  Ptr<Application> app = Application::get();
@@ -159,11 +237,28 @@ extern "C" XI_EXPORT bool run(const char* context)
   }
  }
 
+ // Compute the same total measuring each unique component only once, and the total of
+ // the visible occurrences and bodies only.
+ DesignVolumeTotals allTotals;
+ if (!getDesignVolumeByComponent(design, false, allTotals))
+  return false;
+ DesignVolumeTotals visibleTotals;
+ if (!getDesignVolumeByComponent(design, true, visibleTotals))
+  return false;
+
  // Format a string to display the volume using the default distance units.
  Ptr<UnitsManager> unitMgr = product->unitsManager();
  if(!unitMgr)
   return false;
- /*std::string result = */unitMgr->formatInternalValue(totalVolume, unitMgr->defaultLengthUnits() + "^3", true);
+ std::string volumeUnits = unitMgr->defaultLengthUnits() + "^3";
+ std::stringstream message;
+ message << "Volume: " << unitMgr->formatInternalValue(totalVolume, volumeUnits, true) << "\n";
+ message << "Volume by component: " << unitMgr->formatInternalValue(allTotals.totalVolume, volumeUnits, true) << " ("
+  << allTotals.uniqueComponentCount << " components, " << allTotals.occurrenceCount << " occurrences)\n";
+ message << "Visible volume: " << unitMgr->formatInternalValue(visibleTotals.totalVolume, volumeUnits, true);
+ if (std::fabs(allTotals.totalVolume - totalVolume) > 1e-9 * std::fmax(1.0, std::fabs(totalVolume)))
+  message << "\nThe volume by component does not match the volume of each occurrence.";
+ ui->messageBox(message.str());
 
  return true;
 }
@@ -1,11 +1,36 @@
 #include <Core/Application/Application.h>
 #include <Core/Geometry/Arc3D.h>
 #include <Core/Geometry/Circle3D.h>
+#include <Core/Geometry/Curve3D.h>
+#include <Core/Geometry/Cylinder.h>
+#include <Core/Geometry/Surface.h>
 #include <Core/Geometry/Point3D.h>
 #include <Core/Geometry/Vector3D.h>
 #include <Core/UserInterface/Selection.h>
 #include <Core/UserInterface/UserInterface.h>
 #include <Fusion/BRep/BRepEdge.h>
+#include <Fusion/BRep/BRepEdges.h>
+#include <Fusion/BRep/BRepFace.h>
+#include <Fusion/BRep/BRepFaces.h>
+#include <Fusion/BRep/BRepBody.h>
+#include <Fusion/BRep/BRepBodies.h>
+#include <Fusion/Components/Component.h>
+#include <Fusion/Components/Occurrence.h>
+#include <Fusion/Components/OccurrenceList.h>
+#include <Fusion/Fusion/Design.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <unordered_map>
+#include <vector>
+
+#ifndef XI_WIN
+#include <dlfcn.h>
+#endif
 
 
 using namespace adsk::core;
@@ -13,7 +38,329 @@ using namespace adsk::fusion;
 
 Ptr<UserInterface> ui;
 
+std::string getDllPath();
+
 namespace {
+ const double twoPi = 6.28318530717958647692;
+
+ // Columnar table of all the circular edges (circles and arcs) of a design.
+ // Each column holds one value per edge so that queries only touch the data
+ // they need. Coordinates are in world space.
+ struct CircularEdgeIndex
+ {
+  std::vector<double> centerX, centerY, centerZ;
+  std::vector<double> axisX, axisY, axisZ;
+  std::vector<double> radius;
+  std::vector<double> startAngle, endAngle;
+  std::vector<uint8_t> isFullCircle;
+  std::vector<Ptr<BRepEdge>> edges;
+
+  // Row indices ordered by increasing radius, used by the radius queries.
+  std::vector<uint32_t> byRadius;
+
+  size_t size() const { return radius.size(); }
+ };
+
+ void addCircularEdgeRow(CircularEdgeIndex& index, const Ptr<BRepEdge>& edge,
+        const Ptr<Point3D>& center, const Ptr<Vector3D>& axis,
+        double radius, double startAngle, double endAngle, bool isFullCircle)
+ {
+  index.centerX.push_back(center->x());
+  index.centerY.push_back(center->y());
+  index.centerZ.push_back(center->z());
+  index.axisX.push_back(axis->x());
+  index.axisY.push_back(axis->y());
+  index.axisZ.push_back(axis->z());
+  index.radius.push_back(radius);
+  index.startAngle.push_back(startAngle);
+  index.endAngle.push_back(endAngle);
+  index.isFullCircle.push_back(isFullCircle ? 1 : 0);
+  index.edges.push_back(edge);
+ }
+
+ void addCircularEdgesOfBodies(CircularEdgeIndex& index, const Ptr<BRepBodies>& bodies)
+ {
+  if (!bodies)
+   return;
+
+  for (size_t i = 0; i < bodies->count(); ++i) {
+   Ptr<BRepBody> body = bodies->item(i);
+   if (!body)
+    continue;
+
+   Ptr<BRepEdges> edges = body->edges();
+   if (!edges)
+    continue;
+
+   for (size_t j = 0; j < edges->count(); ++j) {
+    Ptr<BRepEdge> edge = edges->item(j);
+    if (!edge)
+     continue;
+
+    Ptr<Curve3D> curve = edge->geometry();
+    if (!curve)
+     continue;
+
+    Ptr<Point3D> center;
+    Ptr<Vector3D> axis;
+    double radius = 0.0;
+    if (curve->curveType() == Arc3DCurveType) {
+     Ptr<Arc3D> arcGeom = curve;
+     Ptr<Vector3D> refVector;
+     double startAngle = 0.0;
+     double endAngle = 0.0;
+     if (arcGeom && arcGeom->getData(center, axis, refVector, radius, startAngle, endAngle))
+      addCircularEdgeRow(index, edge, center, axis, radius, startAngle, endAngle, false);
+    }
+    else if (curve->curveType() == Circle3DCurveType) {
+     Ptr<Circle3D> circGeom = curve;
+     if (circGeom && circGeom->getData(center, axis, radius))
+      addCircularEdgeRow(index, edge, center, axis, radius, 0.0, twoPi, true);
+    }
+   }
+  }
+ }
+
+ // Builds the index of all the circular edges of the design in one traversal.
+ // Bodies of occurrences are proxies, so their geometry is already in world space.
+ bool buildCircularEdgeIndex(const Ptr<Design>& design, CircularEdgeIndex& index)
+ {
+  index = CircularEdgeIndex();
+  if (!design)
+   return false;
+
+  Ptr<Component> rootComp = design->rootComponent();
+  if (!rootComp)
+   return false;
+
+  addCircularEdgesOfBodies(index, rootComp->bRepBodies());
+
+  Ptr<OccurrenceList> occList = rootComp->allOccurrences();
+  if (!occList)
+   return false;
+  for (size_t i = 0; i < occList->count(); ++i) {
+   Ptr<Occurrence> occ = occList->item(i);
+   if (occ)
+    addCircularEdgesOfBodies(index, occ->bRepBodies());
+  }
+
+  index.byRadius.resize(index.size());
+  for (uint32_t i = 0; i < index.byRadius.size(); ++i)
+   index.byRadius[i] = i;
+  std::sort(index.byRadius.begin(), index.byRadius.end(),
+   [&index](uint32_t a, uint32_t b) { return index.radius[a] < index.radius[b]; });
+
+  return true;
+ }
+
+ // Returns the rows whose radius is within [minRadius, maxRadius].
+ std::vector<uint32_t> findByRadius(const CircularEdgeIndex& index, double minRadius, double maxRadius)
+ {
+  auto first = std::lower_bound(index.byRadius.begin(), index.byRadius.end(), minRadius,
+   [&index](uint32_t row, double value) { return index.radius[row] < value; });
+  auto last = std::upper_bound(first, index.byRadius.end(), maxRadius,
+   [&index](double value, uint32_t row) { return value < index.radius[row]; });
+
+  std::vector<uint32_t> rows(first, last);
+  std::sort(rows.begin(), rows.end());
+  return rows;
+ }
+
+ // Returns the rows whose radius is within [minRadius, maxRadius] and whose axis is
+ // parallel (in either direction) to the given direction within the angle tolerance.
+ std::vector<uint32_t> findByRadiusAndAxis(const CircularEdgeIndex& index, double minRadius, double maxRadius,
+             const Ptr<Vector3D>& direction, double angleTolerance)
+ {
+  std::vector<uint32_t> rows = findByRadius(index, minRadius, maxRadius);
+  if (!direction)
+   return rows;
+
+  double dx = direction->x(), dy = direction->y(), dz = direction->z();
+  double length = std::sqrt(dx * dx + dy * dy + dz * dz);
+  if (length == 0.0)
+   return rows;
+  dx /= length; dy /= length; dz /= length;
+
+  double minCos = std::cos(angleTolerance);
+  rows.erase(std::remove_if(rows.begin(), rows.end(), [&](uint32_t row) {
+   double dot = index.axisX[row] * dx + index.axisY[row] * dy + index.axisZ[row] * dz;
+   return std::fabs(dot) < minCos;
+  }), rows.end());
+  return rows;
+ }
+
+ // Writes the columns of the index to a binary file: a "CEIX" tag, a version,
+ // the row count, then each column stored contiguously. Values are written in the
+ // native byte order of the host, which is little endian on every platform Fusion runs on.
+ bool writeCircularEdgeIndex(const CircularEdgeIndex& index, const std::string& filePath)
+ {
+  std::ofstream outfile(filePath, std::ios::binary | std::ios::trunc);
+  if (!outfile)
+   return false;
+
+  const char tag[4] = { 'C', 'E', 'I', 'X' };
+  uint32_t version = 1;
+  uint64_t rowCount = index.size();
+  outfile.write(tag, sizeof(tag));
+  outfile.write(reinterpret_cast<const char*>(&version), sizeof(version));
+  outfile.write(reinterpret_cast<const char*>(&rowCount), sizeof(rowCount));
+
+  const std::vector<double>* columns[] = {
+   &index.centerX, &index.centerY, &index.centerZ,
+   &index.axisX, &index.axisY, &index.axisZ,
+   &index.radius, &index.startAngle, &index.endAngle
+  };
+  for (const std::vector<double>* column : columns)
+   outfile.write(reinterpret_cast<const char*>(column->data()), column->size() * sizeof(double));
+  outfile.write(reinterpret_cast<const char*>(index.isFullCircle.data()), index.isFullCircle.size());
+
+  return outfile.good();
+ }
+
+ // Indices of the edges and faces of a body bucketed by the type of their geometry.
+ struct BodyGeometryClassification
+ {
+  std::string revisionId;
+  std::map<Curve3DTypes, std::vector<size_t>> edgesByType;
+  std::map<SurfaceTypes, std::vector<size_t>> facesByType;
+ };
+
+ // Classifies the edges and faces of bodies by geometry type, walking each body
+ // once. The classification of a body is cached by entityToken and is reused as
+ // long as the revisionId of the body does not change.
+ class BodyGeometryClassifier
+ {
+ public:
+  // Returns the classification of the body, or nullptr if the body is invalid.
+  const BodyGeometryClassification* classify(const Ptr<BRepBody>& body)
+  {
+   if (!body)
+    return nullptr;
+
+   std::string revisionId = body->revisionId();
+   BodyGeometryClassification& classification = m_bodies[body->entityToken()];
+   if (classification.revisionId == revisionId && !revisionId.empty())
+    return &classification;
+
+   classification.revisionId = revisionId;
+   classification.edgesByType.clear();
+   classification.facesByType.clear();
+
+   Ptr<BRepEdges> edges = body->edges();
+   if (edges) {
+    for (size_t i = 0; i < edges->count(); ++i) {
+     Ptr<BRepEdge> edge = edges->item(i);
+     if (!edge)
+      continue;
+     Ptr<Curve3D> curve = edge->geometry();
+     if (curve)
+      classification.edgesByType[curve->curveType()].push_back(i);
+    }
+   }
+
+   Ptr<BRepFaces> faces = body->faces();
+   if (faces) {
+    for (size_t i = 0; i < faces->count(); ++i) {
+     Ptr<BRepFace> face = faces->item(i);
+     if (!face)
+      continue;
+     Ptr<Surface> surface = face->geometry();
+     if (surface)
+      classification.facesByType[surface->surfaceType()].push_back(i);
+    }
+   }
+
+   return &classification;
+  }
+
+  // Returns the indices of the edges of the body whose geometry is of the given type.
+  const std::vector<size_t>& edgeIndices(const Ptr<BRepBody>& body, Curve3DTypes curveType)
+  {
+   const BodyGeometryClassification* classification = classify(body);
+   if (!classification)
+    return m_noIndices;
+   auto it = classification->edgesByType.find(curveType);
+   return it != classification->edgesByType.end() ? it->second : m_noIndices;
+  }
+
+  // Returns the indices of the faces of the body whose geometry is of the given type.
+  const std::vector<size_t>& faceIndices(const Ptr<BRepBody>& body, SurfaceTypes surfaceType)
+  {
+   const BodyGeometryClassification* classification = classify(body);
+   if (!classification)
+    return m_noIndices;
+   auto it = classification->facesByType.find(surfaceType);
+   return it != classification->facesByType.end() ? it->second : m_noIndices;
+  }
+
+  // Removes the classifications of the bodies that are not found in the design, such
+  // as deleted bodies or the bodies of another document, and returns how many were removed.
+  size_t evictMissing(const Ptr<Design>& design)
+  {
+   size_t count = 0;
+   for (auto it = m_bodies.begin(); it != m_bodies.end();) {
+    if (!design || design->findEntityByToken(it->first).empty()) {
+     it = m_bodies.erase(it);
+     ++count;
+    }
+    else {
+     ++it;
+    }
+   }
+   return count;
+  }
+
+ private:
+  std::unordered_map<std::string, BodyGeometryClassification> m_bodies;
+  const std::vector<size_t> m_noIndices;
+ };
+
+ // Kept for as long as the module is loaded, so the classifications of bodies that have not
+ // changed are reused by later runs.
+ BodyGeometryClassifier bodyClassifier;
+
+ std::string getCurveTypeName(Curve3DTypes curveType)
+ {
+  switch (curveType) {
+  case Line3DCurveType: return "Line";
+  case Arc3DCurveType: return "Arc";
+  case Circle3DCurveType: return "Circle";
+  case Ellipse3DCurveType: return "Ellipse";
+  case EllipticalArc3DCurveType: return "Elliptical arc";
+  case InfiniteLine3DCurveType: return "Infinite line";
+  case NurbsCurve3DCurveType: return "NURBS curve";
+  default: return "Other curve";
+  }
+ }
+
+ std::string getSurfaceTypeName(SurfaceTypes surfaceType)
+ {
+  switch (surfaceType) {
+  case PlaneSurfaceType: return "Plane";
+  case CylinderSurfaceType: return "Cylinder";
+  case ConeSurfaceType: return "Cone";
+  case SphereSurfaceType: return "Sphere";
+  case TorusSurfaceType: return "Torus";
+  case EllipticalCylinderSurfaceType: return "Elliptical cylinder";
+  case EllipticalConeSurfaceType: return "Elliptical cone";
+  case NurbsSurfaceType: return "NURBS surface";
+  default: return "Other surface";
+  }
+ }
+
+ // Formats the number of edges and faces per geometry type.
+ std::string getGeometryHistogramInfo(const BodyGeometryClassification& classification)
+ {
+  std::stringstream ss;
+  ss << "Edges:\n";
+  for (const auto& bucket : classification.edgesByType)
+   ss << "  " << getCurveTypeName(bucket.first) << ": " << bucket.second.size() << "\n";
+  ss << "Faces:\n";
+  for (const auto& bucket : classification.facesByType)
+   ss << "  " << getSurfaceTypeName(bucket.first) << ": " << bucket.second.size() << "\n";
+  return ss.str();
+ }
+
  std::string getArcGeometryInfo(Ptr<Arc3D> arcGeom)
  {
   std::string arcInfo;
@@ -96,6 +443,62 @@ extern "C" XI_EXPORT bool run(const char* context)
   ui->messageBox(circleInfo, "Circle Info");
  }
 
+ // Index all the circular edges of the design and find the ones matching the selected edge.
+ Ptr<Design> design = app->activeProduct();
+ if (!design)
+  return false;
+
+ CircularEdgeIndex index;
+ if (!buildCircularEdgeIndex(design, index))
+  return false;
+
+ Ptr<Vector3D> axis;
+ double radius = 0.0;
+ if (Ptr<Arc3D> arcGeom = edge->geometry()) {
+  axis = arcGeom->normal();
+  radius = arcGeom->radius();
+ }
+ else if (Ptr<Circle3D> circGeom = edge->geometry()) {
+  axis = circGeom->normal();
+  radius = circGeom->radius();
+ }
+
+ // The radius tolerance is a length in cm, the axis tolerance an angle in radians.
+ const double radiusTolerance = 1e-6;
+ const double axisAngleTolerance = 1e-6;
+ std::vector<uint32_t> matches = findByRadiusAndAxis(index, radius - radiusTolerance, radius + radiusTolerance, axis, axisAngleTolerance);
+
+ std::stringstream ss;
+ ss << "Circular edges in the design: " << index.size() << "\n";
+ ss << "Edges with the same radius and axis: " << matches.size() << "\n";
+ ui->messageBox(ss.str(), "Circular Edge Index");
+
+ // Classify the edges and faces of the body owning the selected edge, after dropping
+ // the classifications of bodies that are gone.
+ bodyClassifier.evictMissing(design);
+ const BodyGeometryClassification* classification = bodyClassifier.classify(edge->body());
+ if (!classification)
+  return false;
+
+ // The classification is cached, so fetching a bucket does not walk the body again, and
+ // only the cylindrical faces are visited to find the ones of the edge's radius.
+ const std::vector<size_t>& cylindricalFaces = bodyClassifier.faceIndices(edge->body(), CylinderSurfaceType);
+ size_t sameRadiusCount = 0;
+ Ptr<BRepFaces> bodyFaces = edge->body()->faces();
+ for (size_t i = 0; bodyFaces && i < cylindricalFaces.size(); ++i) {
+  Ptr<BRepFace> face = bodyFaces->item(cylindricalFaces[i]);
+  Ptr<Cylinder> cylinder = face ? face->geometry() : nullptr;
+  if (cylinder && std::abs(cylinder->radius() - radius) <= radiusTolerance)
+   ++sameRadiusCount;
+ }
+
+ std::stringstream histogram;
+ histogram << getGeometryHistogramInfo(*classification);
+ histogram << "Cylindrical faces with the radius of the edge: " << sameRadiusCount << "\n";
+ ui->messageBox(histogram.str(), "Body Geometry Types");
+
+ writeCircularEdgeIndex(index, getDllPath() + "/" + "CircularEdgeIndex.bin");
+
  return true;
 }
 
@@ -117,4 +520,33 @@ BOOL APIENTRY DllMain(HMODULE hmodule, DWORD reason, LPVOID reserved)
  return TRUE;
 }
 
-#endif // XI_WIN
\ No newline at end of file
+#endif // XI_WIN
+
+std::string getDllPath()
+{
+#if defined(_WINDOWS) || defined(_WIN32) || defined(_WIN64)
+ HMODULE hModule = NULL;
+ if (!GetModuleHandleExA(GET_MODULE_HANDLE_EX_FLAG_FROM_ADDRESS |
+  GET_MODULE_HANDLE_EX_FLAG_UNCHANGED_REFCOUNT,
+  (LPCSTR)&getDllPath,
+  &hModule))
+  return "";
+
+ char winTempPath[2048];
+ ::GetModuleFileNameA(hModule, winTempPath, 2048);
+
+ std::string strPath = winTempPath;
+ size_t stPos = strPath.rfind('\\');
+ return strPath.substr(0, stPos);
+#else
+ Dl_info info;
+ dladdr((void*)getDllPath, &info);
+
+ std::string strPath = info.dli_fname;
+ int stPos = (int)strPath.rfind('/');
+ if (stPos != -1)
+  return strPath.substr(0, stPos);
+ else
+  return "";
+#endif
+}
\ No newline at end of file
@@ -2,6 +2,16 @@
 #include <Fusion/FusionAll.h>
 #include <sstream>
 #include <iomanip>
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#ifndef XI_WIN
+#include <dlfcn.h>
+#endif
 
 
 using namespace adsk::core;
@@ -9,6 +19,322 @@ using namespace adsk::fusion;
 
 Ptr<UserInterface> ui;
 
+std::string getDllPath();
+
+// Axis aligned bounding box in world space.
+struct Aabb
+{
+    double min[3];
+    double max[3];
+};
+
+// Finds the pairs of boxes that overlap using sweep and prune. The boxes are sorted
+// by their minimum along the axis with the largest spread, then swept while keeping
+// the list of boxes whose interval is still open. Only boxes overlapping along the
+// sweep axis are tested on the two other axes.
+std::vector<std::pair<size_t, size_t>> findOverlappingPairs(const std::vector<Aabb>& boxes)
+{
+    std::vector<std::pair<size_t, size_t>> pairs;
+    if (boxes.size() < 2)
+        return pairs;
+
+    // Use the axis along which the box centers are the most spread out.
+    int axis = 0;
+    double largestSpread = -1.0;
+    for (int a = 0; a < 3; ++a) {
+        double lowest = boxes[0].min[a] + boxes[0].max[a];
+        double highest = lowest;
+        for (const Aabb& box : boxes) {
+            double center = box.min[a] + box.max[a];
+            lowest = std::min(lowest, center);
+            highest = std::max(highest, center);
+        }
+        if (highest - lowest > largestSpread) {
+            largestSpread = highest - lowest;
+            axis = a;
+        }
+    }
+
+    std::vector<size_t> order(boxes.size());
+    for (size_t i = 0; i < order.size(); ++i)
+        order[i] = i;
+    std::sort(order.begin(), order.end(), [&](size_t a, size_t b) { return boxes[a].min[axis] < boxes[b].min[axis]; });
+
+    int otherAxis1 = (axis + 1) % 3;
+    int otherAxis2 = (axis + 2) % 3;
+    std::vector<size_t> active;
+    for (size_t index : order) {
+        const Aabb& box = boxes[index];
+
+        // Drop the boxes that end before this one starts.
+        active.erase(std::remove_if(active.begin(), active.end(),
+            [&](size_t other) { return boxes[other].max[axis] < box.min[axis]; }), active.end());
+
+        for (size_t other : active) {
+            const Aabb& otherBox = boxes[other];
+            if (box.min[otherAxis1] <= otherBox.max[otherAxis1] && otherBox.min[otherAxis1] <= box.max[otherAxis1] &&
+                box.min[otherAxis2] <= otherBox.max[otherAxis2] && otherBox.min[otherAxis2] <= box.max[otherAxis2])
+                pairs.push_back(std::make_pair(std::min(index, other), std::max(index, other)));
+        }
+        active.push_back(index);
+    }
+
+    return pairs;
+}
+
+// Groups the entities connected by candidate pairs. Returns one list of entity
+// indices per group of two or more entities.
+std::vector<std::vector<size_t>> groupCandidatePairs(size_t entityCount, const std::vector<std::pair<size_t, size_t>>& pairs)
+{
+    std::vector<size_t> parents(entityCount);
+    for (size_t i = 0; i < entityCount; ++i)
+        parents[i] = i;
+
+    auto findRoot = [&](size_t i) {
+        while (parents[i] != i) {
+            parents[i] = parents[parents[i]];
+            i = parents[i];
+        }
+        return i;
+    };
+
+    for (const std::pair<size_t, size_t>& pair : pairs) {
+        size_t root1 = findRoot(pair.first);
+        size_t root2 = findRoot(pair.second);
+        if (root1 != root2)
+            parents[std::max(root1, root2)] = std::min(root1, root2);
+    }
+
+    std::vector<std::vector<size_t>> groups;
+    std::vector<size_t> groupOfRoot(entityCount, entityCount);
+    for (size_t i = 0; i < entityCount; ++i) {
+        size_t root = findRoot(i);
+        if (groupOfRoot[root] == entityCount) {
+            groupOfRoot[root] = groups.size();
+            groups.push_back(std::vector<size_t>());
+        }
+        groups[groupOfRoot[root]].push_back(i);
+    }
+
+    groups.erase(std::remove_if(groups.begin(), groups.end(),
+        [](const std::vector<size_t>& group) { return group.size() < 2; }), groups.end());
+    return groups;
+}
+
+// Statistics of an interference analysis preceded by a broad phase.
+struct BroadPhaseReport
+{
+    size_t entityCount = 0;
+    size_t totalPairCount = 0;
+    size_t candidatePairCount = 0;
+    size_t prunedPairCount = 0;
+    size_t clusterCount = 0;
+    size_t pairAnalysisCount = 0;
+    double broadPhaseSeconds = 0.0;
+    double exactSeconds = 0.0;
+};
+
+bool getWorldBoundingBox(const Ptr<Base>& entity, Aabb& box)
+{
+    Ptr<BoundingBox3D> boundingBox;
+    if (Ptr<Occurrence> occurrence = entity)
+        boundingBox = occurrence->boundingBox();
+    else if (Ptr<BRepBody> body = entity)
+        boundingBox = body->boundingBox();
+    if (!boundingBox)
+        return false;
+
+    Ptr<Point3D> minPoint = boundingBox->minPoint();
+    Ptr<Point3D> maxPoint = boundingBox->maxPoint();
+    if (!minPoint || !maxPoint)
+        return false;
+    minPoint->getData(box.min[0], box.min[1], box.min[2]);
+    maxPoint->getData(box.max[0], box.max[1], box.max[2]);
+    return true;
+}
+
+// Analyzes the interference between occurrences or bodies, running the exact
+// analysis only on entities whose bounding boxes overlap instead of handing all
+// the entities, and all their pairs, to the kernel at once. Overlaps chain the
+// entities into clusters. A cluster whose entities mostly overlap each other is
+// analyzed at once. A sparse one, such as parts packed in a frame that overlaps
+// them all, is analyzed one candidate pair at a time, so it never falls back to
+// all the pairs of the cluster.
+bool analyzeInterferenceWithBroadPhase(const Ptr<Design>& design, const Ptr<ObjectCollection>& entities,
+                                       bool areCoincidentFacesIncluded,
+                                       std::vector<Ptr<InterferenceResults>>& results, BroadPhaseReport& report)
+{
+    results.clear();
+    report = BroadPhaseReport();
+    if (!design || !entities)
+        return false;
+
+    std::chrono::steady_clock::time_point startTime = std::chrono::steady_clock::now();
+
+    // Broad phase: compare the world bounding boxes.
+    std::vector<Aabb> boxes(entities->count());
+    for (size_t i = 0; i < boxes.size(); ++i) {
+        if (!getWorldBoundingBox(entities->item(i), boxes[i]))
+            return false;
+    }
+    std::vector<std::pair<size_t, size_t>> pairs = findOverlappingPairs(boxes);
+    std::vector<std::vector<size_t>> clusters = groupCandidatePairs(boxes.size(), pairs);
+
+    std::chrono::steady_clock::time_point broadPhaseEndTime = std::chrono::steady_clock::now();
+
+    report.entityCount = boxes.size();
+    report.totalPairCount = boxes.size() < 2 ? 0 : boxes.size() * (boxes.size() - 1) / 2;
+    report.candidatePairCount = pairs.size();
+    report.prunedPairCount = report.totalPairCount - report.candidatePairCount;
+    report.broadPhaseSeconds = std::chrono::duration<double>(broadPhaseEndTime - startTime).count();
+
+    auto analyze = [&](const std::vector<size_t>& indices) {
+        Ptr<ObjectCollection> analyzedEntities = ObjectCollection::create();
+        if (!analyzedEntities)
+            return false;
+        for (size_t index : indices)
+            analyzedEntities->add(entities->item(index));
+
+        Ptr<InterferenceInput> interferenceInput = design->createInterferenceInput(analyzedEntities);
+        if (!interferenceInput)
+            return false;
+        interferenceInput->areCoincidentFacesIncluded(areCoincidentFacesIncluded);
+        Ptr<InterferenceResults> analyzedResults = design->analyzeInterference(interferenceInput);
+        if (!analyzedResults)
+            return false;
+        results.push_back(analyzedResults);
+        return true;
+    };
+
+    // Exact phase: sort the candidate pairs by cluster, then analyze each cluster at once
+    // if at least half of its pairs are candidates, or else pair by pair.
+    std::vector<size_t> clusterOfEntity(boxes.size(), clusters.size());
+    for (size_t c = 0; c < clusters.size(); ++c) {
+        for (size_t index : clusters[c])
+            clusterOfEntity[index] = c;
+    }
+    std::vector<std::vector<size_t>> clusterPairs(clusters.size());
+    for (size_t i = 0; i < pairs.size(); ++i)
+        clusterPairs[clusterOfEntity[pairs[i].first]].push_back(i);
+
+    report.clusterCount = 0;
+    for (size_t c = 0; c < clusters.size(); ++c) {
+        size_t clusterSize = clusters[c].size();
+        if (clusterPairs[c].size() * 2 >= clusterSize * (clusterSize - 1) / 2) {
+            if (!analyze(clusters[c]))
+                return false;
+            ++report.clusterCount;
+            continue;
+        }
+        for (size_t pairIndex : clusterPairs[c]) {
+            std::vector<size_t> pair = { pairs[pairIndex].first, pairs[pairIndex].second };
+            if (!analyze(pair))
+                return false;
+            ++report.pairAnalysisCount;
+        }
+    }
+
+    report.exactSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - broadPhaseEndTime).count();
+    return true;
+}
+
+// Gets the component and entity names of an interfering body or occurrence.
+void getInterferenceEntityNames(const Ptr<Base>& entity, std::string& componentName, std::string& entityName)
+{
+    componentName.clear();
+    entityName.clear();
+    if (Ptr<BRepBody> body = entity)
+    {
+        Ptr<Component> comp = body->parentComponent();
+        if (comp)
+            componentName = comp->name();
+        entityName = body->name();
+    }
+    else if (Ptr<Occurrence> occ = entity)
+    {
+        Ptr<Component> comp = occ->component();
+        if (comp)
+            componentName = comp->name();
+        entityName = occ->name();
+    }
+}
+
+std::string toCsvField(const std::string& value)
+{
+    std::string field = "\"";
+    for (char c : value)
+    {
+        if (c == '"')
+            field += '"';
+        field += c;
+    }
+    field += '"';
+    return field;
+}
+
+// Writes one CSV row per interference result of one or more analyses as soon as it is
+// read, without creating any body. InterferenceApiSample also writes the report as JSON.
+bool writeInterferenceCsv(const std::vector<Ptr<InterferenceResults>>& analyses, std::ostream& out, size_t& resultCount)
+{
+    resultCount = 0;
+
+    out.precision(9);
+    out << "index,component1,entity1,component2,entity2,volume\n";
+
+    std::string comp1Name, entity1Name, comp2Name, entity2Name;
+    for (const Ptr<InterferenceResults>& results : analyses)
+    {
+        if (!results)
+            return false;
+        size_t count = results->count();
+        for (size_t j = 0; j < count; ++j)
+        {
+            Ptr<InterferenceResult> result = results->item(j);
+            if (!result)
+                return false;
+
+            getInterferenceEntityNames(result->entityOne(), comp1Name, entity1Name);
+            getInterferenceEntityNames(result->entityTwo(), comp2Name, entity2Name);
+
+            double volume = 0.0;
+            Ptr<BRepBody> interferenceBody = result->interferenceBody();
+            if (interferenceBody)
+                volume = interferenceBody->volume();
+
+            out << resultCount << "," << toCsvField(comp1Name) << "," << toCsvField(entity1Name) << ","
+                << toCsvField(comp2Name) << "," << toCsvField(entity2Name) << "," << volume << "\n";
+            ++resultCount;
+        }
+    }
+
+    out.flush();
+    return out.good();
+}
+
+// Flags only the first maxCreatedBodies results of the analyses, so that createBodies
+// on each of them creates at most that many bodies in all.
+bool flagCreatedBodies(const std::vector<Ptr<InterferenceResults>>& analyses, size_t maxCreatedBodies)
+{
+    size_t flaggedCount = 0;
+    for (const Ptr<InterferenceResults>& results : analyses)
+    {
+        if (!results)
+            return false;
+        size_t count = results->count();
+        for (size_t j = 0; j < count; ++j)
+        {
+            Ptr<InterferenceResult> result = results->item(j);
+            if (!result)
+                return false;
+            bool isCreated = flaggedCount < maxCreatedBodies;
+            result->isCreateBody(isCreated);
+            if (isCreated)
+                ++flaggedCount;
+        }
+    }
+    return true;
+}
+
 extern "C" XI_EXPORT bool run(const char* context)
 {
     Ptr<Application> app = Application::get();
@@ -173,24 +499,81 @@ extern "C" XI_EXPORT bool run(const char* context)
     inputOccurrences->add(secondComponentOccurrence);
     inputOccurrences->add(thirdComponentOccurrence);
 
-    // Create the interferenceInput object and run the analysis.
-    Ptr<InterferenceInput> interferenceInput = design->createInterferenceInput(inputOccurrences);
-    if (!interferenceInput)
-    return false;
-    interferenceInput->areCoincidentFacesIncluded(false);
-    Ptr<InterferenceResults> results = design->analyzeInterference(interferenceInput);
-    if (!results)
-    return false;
+    // Run the analysis with a bounding box broad phase, only on the clusters of candidate occurrences.
+    std::vector<Ptr<InterferenceResults>> clusterResults;
+    BroadPhaseReport broadPhaseReport;
+    if (!analyzeInterferenceWithBroadPhase(design, inputOccurrences, false, clusterResults, broadPhaseReport))
+        return false;
 
-    // Create bodies for every intersection.  This is not supported in Parametric designs.
-    Ptr<ObjectCollection> interferenceBodies = results->createBodies(true);
-    if (!interferenceBodies)
-    return false;
+    // On request, also analyze all the occurrences at once to measure the time saved.
+    double fullAnalysisSeconds = -1.0;
+    if (ui->messageBox("Also analyze all the occurrences at once to measure the time saved?", "Interference Broad Phase",
+            MessageBoxButtonTypes::YesNoButtonType, MessageBoxIconTypes::QuestionIconType) == DialogResults::DialogYes) {
+        std::chrono::steady_clock::time_point fullAnalysisStartTime = std::chrono::steady_clock::now();
+        Ptr<InterferenceInput> interferenceInput = design->createInterferenceInput(inputOccurrences);
+        if (!interferenceInput)
+            return false;
+        interferenceInput->areCoincidentFacesIncluded(false);
+        Ptr<InterferenceResults> results = design->analyzeInterference(interferenceInput);
+        if (!results)
+            return false;
+        fullAnalysisSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - fullAnalysisStartTime).count();
+    }
 
-    Ptr<Occurrence> resultsOccurrence = occurrences->item(occurrences->count()-1);
-    if (!resultsOccurrence)
-    return false;
-    resultsOccurrence->activate();
+    // Report what the broad phase saved compared to the analysis of all the occurrences.
+    double analysisSeconds = broadPhaseReport.broadPhaseSeconds + broadPhaseReport.exactSeconds;
+    std::stringstream broadPhaseString;
+    broadPhaseString << std::setprecision(3) << std::fixed;
+    broadPhaseString << "Candidate pairs: " << broadPhaseReport.candidatePairCount << " of " << broadPhaseReport.totalPairCount << "\n";
+    broadPhaseString << "Pruned pairs: " << broadPhaseReport.prunedPairCount << "\n";
+    broadPhaseString << "Clusters analyzed at once: " << broadPhaseReport.clusterCount << "\n";
+    broadPhaseString << "Pairs analyzed one by one: " << broadPhaseReport.pairAnalysisCount << "\n";
+    broadPhaseString << "With the broad phase: " << analysisSeconds << " s ("
+        << broadPhaseReport.broadPhaseSeconds << " s of it comparing boxes)";
+    if (fullAnalysisSeconds >= 0.0) {
+        broadPhaseString << "\nAnalysis of all occurrences: " << fullAnalysisSeconds << " s\n";
+        broadPhaseString << "Time saved: " << std::max(0.0, fullAnalysisSeconds - analysisSeconds) << " s";
+    }
+    ui->messageBox(broadPhaseString.str(), "Interference Broad Phase");
+
+    // Report every interference found by the broad phase analysis without creating any body.
+    std::ofstream reportFile(getDllPath() + "/" + "InterferenceReport.csv", std::ios::trunc);
+    if (!reportFile)
+        return false;
+    size_t resultCount = 0;
+    if (!writeInterferenceCsv(clusterResults, reportFile, resultCount))
+        return false;
+    if (!flagCreatedBodies(clusterResults, 100))
+        return false;
+
+    // Create bodies, only for the flagged results.  This is not supported in Parametric designs.
+    // The bodies of all the analyses go to the root component rather than to one new component
+    // per analysis, so there is no new occurrence to activate.
+    std::stringstream resultsString;
+    resultsString << resultCount << " interferences written to InterferenceReport.csv\n";
+    for (const Ptr<InterferenceResults>& analysisResults : clusterResults) {
+        Ptr<ObjectCollection> interferenceBodies = analysisResults->createBodies(false);
+        if (!interferenceBodies)
+            return false;
+
+        // The bodies are created in the order of the flagged results.
+        size_t bodCount = 0;
+        for (Ptr<InterferenceResult> result : analysisResults) {
+            if (!result->isCreateBody())
+                continue;
+            std::string comp1Name, entity1Name, comp2Name, entity2Name;
+            getInterferenceEntityNames(result->entityOne(), comp1Name, entity1Name);
+            getInterferenceEntityNames(result->entityTwo(), comp2Name, entity2Name);
+
+            Ptr<BRepBody> interferenceBody = interferenceBodies->item(bodCount);
+            if (!interferenceBody)
+                return false;
+            bodCount++;
+            interferenceBody->name("Interference between " + comp1Name + " & " + comp2Name);
+            resultsString << "There is interference between " << comp1Name << " and " << comp2Name << " with a volume of "
+                << std::setprecision(2) << std::fixed << interferenceBody->volume() << " cubic centimeters\n";
+        }
+    }
 
     // Fit the view        
     Ptr<Viewport> viewport = app->activeViewport();
@@ -198,30 +581,7 @@ extern "C" XI_EXPORT bool run(const char* context)
     return false;
     viewport->fit();
 
-    // Report the results
-    int bodCount = 0;
-    for (Ptr<InterferenceResult> result : results) {
-        Ptr<BRepBody>entOneBody = result->entityOne();
-        if (!entOneBody)
-            return false;
-        std::string comp1Name = entOneBody->parentComponent()->name();
-
-        Ptr<BRepBody>entTwoBody = result->entityTwo();
-        if (!entTwoBody)
-            return false;
-        std::string comp2Name = entTwoBody->parentComponent()->name();
-
-        double bodyVolume = result->interferenceBody()->volume();
-        std::stringstream bodyVolumeString;
-        bodyVolumeString << std::setprecision(2) << std::fixed << bodyVolume;
-            
-        Ptr<BRepBody> interferenceBody = interferenceBodies->item(bodCount);
-        if (!interferenceBody)
-            return false;
-        bodCount++;
-        interferenceBody->name("Interference between " + comp1Name + " & " + comp2Name);
-        ui->messageBox("There is interference between " + comp1Name + " and " + comp2Name + " with a volume of " + bodyVolumeString.str() + " cubic centimeters");
-    }
+    ui->messageBox(resultsString.str());
 
     return true;
 }
@@ -244,4 +604,33 @@ BOOL APIENTRY DllMain(HMODULE hmodule, DWORD reason, LPVOID reserved)
     return TRUE;
 }
 
-#endif // XI_WIN
\ No newline at end of file
+#endif // XI_WIN
+
+std::string getDllPath()
+{
+#if defined(_WINDOWS) || defined(_WIN32) || defined(_WIN64)
+    HMODULE hModule = NULL;
+    if (!GetModuleHandleExA(GET_MODULE_HANDLE_EX_FLAG_FROM_ADDRESS |
+        GET_MODULE_HANDLE_EX_FLAG_UNCHANGED_REFCOUNT,
+        (LPCSTR)&getDllPath,
+        &hModule))
+        return "";
+
+    char winTempPath[2048];
+    ::GetModuleFileNameA(hModule, winTempPath, 2048);
+
+    std::string strPath = winTempPath;
+    size_t stPos = strPath.rfind('\\');
+    return strPath.substr(0, stPos);
+#else
+    Dl_info info;
+    dladdr((void*)getDllPath, &info);
+
+    std::string strPath = info.dli_fname;
+    int stPos = (int)strPath.rfind('/');
+    if (stPos != -1)
+        return strPath.substr(0, stPos);
+    else
+        return "";
+#endif
+}
\ No newline at end of file
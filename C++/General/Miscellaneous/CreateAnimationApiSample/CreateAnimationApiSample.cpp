@@ -6,9 +6,23 @@
 #include <Fusion/Fusion/Design.h>
 #include <Fusion/Fusion/Parameter.h>
 #include <Fusion/Fusion/ParameterList.h>
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <functional>
 #include <iostream>
 #include <iomanip> 
+#include <memory>
+#include <mutex>
+#include <queue>
 #include <sstream>
+#include <thread>
+#include <vector>
 
 using namespace adsk::core;
 using namespace adsk::fusion;
@@ -24,6 +38,404 @@ std::string pad(int number, int length)
  return ss.str();
 }
 
+// Gets the 64 bit FNV-1a hash of the bytes.
+uint64_t hashBytes(const void* data, size_t size, uint64_t hash = 14695981039346656037ULL)
+{
+ const unsigned char* bytes = static_cast<const unsigned char*>(data);
+ for (size_t i = 0; i < size; ++i)
+ {
+  hash ^= bytes[i];
+  hash *= 1099511628211ULL;
+ }
+ return hash;
+}
+
+// Image read from an uncompressed BMP file, as 8 bit RGB rows from the top down.
+struct RgbImage
+{
+ int width = 0;
+ int height = 0;
+ std::vector<unsigned char> pixels;
+};
+
+uint32_t readLittleEndian(const unsigned char* data, int size)
+{
+ uint32_t value = 0;
+ for (int i = size - 1; i >= 0; --i)
+  value = (value << 8) | data[i];
+ return value;
+}
+
+// Reads a 24 or 32 bit uncompressed BMP file, which is what the viewport writes when
+// asked for a .bmp. 32 bit pixels are taken as BGRA and the alpha is dropped.
+bool readBmpFile(const std::string& filePath, RgbImage& image)
+{
+ std::ifstream file(filePath.c_str(), std::ios::binary);
+ std::vector<unsigned char> data((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+ if (data.size() < 54 || data[0] != 'B' || data[1] != 'M')
+  return false;
+ uint32_t pixelOffset = readLittleEndian(&data[10], 4);
+ int32_t width = static_cast<int32_t>(readLittleEndian(&data[18], 4));
+ int32_t height = static_cast<int32_t>(readLittleEndian(&data[22], 4));
+ uint32_t bitCount = readLittleEndian(&data[28], 2);
+ uint32_t compression = readLittleEndian(&data[30], 4);
+ if (width <= 0 || height == 0 || (bitCount != 24 && bitCount != 32) || (compression != 0 && compression != 3))
+  return false;
+
+ bool isTopDown = height < 0;
+ image.width = width;
+ image.height = isTopDown ? -height : height;
+ size_t bytesPerPixel = bitCount / 8;
+ size_t stride = (static_cast<size_t>(width) * bitCount + 31) / 32 * 4;
+ if (pixelOffset + stride * image.height > data.size())
+  return false;
+
+ image.pixels.resize(static_cast<size_t>(image.width) * image.height * 3);
+ for (int y = 0; y < image.height; ++y)
+ {
+  const unsigned char* source = &data[pixelOffset + stride * (isTopDown ? y : image.height - 1 - y)];
+  unsigned char* target = &image.pixels[static_cast<size_t>(y) * image.width * 3];
+  for (int x = 0; x < image.width; ++x, source += bytesPerPixel, target += 3)
+  {
+   target[0] = source[2];
+   target[1] = source[1];
+   target[2] = source[0];
+  }
+ }
+ return true;
+}
+
+// Writes the bits of a deflate stream, least significant first.
+class DeflateBitWriter
+{
+public:
+ explicit DeflateBitWriter(std::vector<unsigned char>& out) : m_out(out) {}
+
+ void writeBits(uint32_t value, int count)
+ {
+  m_bits |= static_cast<uint64_t>(value) << m_bitCount;
+  m_bitCount += count;
+  while (m_bitCount >= 8)
+  {
+   m_out.push_back(static_cast<unsigned char>(m_bits));
+   m_bits >>= 8;
+   m_bitCount -= 8;
+  }
+ }
+
+ // Huffman codes are stored from their most significant bit.
+ void writeCode(uint32_t code, int length)
+ {
+  uint32_t reversed = 0;
+  for (int i = 0; i < length; ++i)
+   reversed |= ((code >> i) & 1) << (length - 1 - i);
+  writeBits(reversed, length);
+ }
+
+ void flush()
+ {
+  if (m_bitCount > 0)
+   m_out.push_back(static_cast<unsigned char>(m_bits));
+  m_bits = 0;
+  m_bitCount = 0;
+ }
+
+private:
+ std::vector<unsigned char>& m_out;
+ uint64_t m_bits = 0;
+ int m_bitCount = 0;
+};
+
+// Writes a literal or length symbol with the fixed Huffman code of deflate.
+void writeFixedLiteral(DeflateBitWriter& writer, int symbol)
+{
+ if (symbol < 144)
+  writer.writeCode(0x30 + symbol, 8);
+ else if (symbol < 256)
+  writer.writeCode(0x190 + symbol - 144, 9);
+ else if (symbol < 280)
+  writer.writeCode(symbol - 256, 7);
+ else
+  writer.writeCode(0xC0 + symbol - 280, 8);
+}
+
+void writeFixedMatch(DeflateBitWriter& writer, int length, int distance)
+{
+ static const int lengthBases[29] = { 3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+ static const int lengthExtraBits[29] = { 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+ static const int distanceBases[30] = { 1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577 };
+ static const int distanceExtraBits[30] = { 0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+
+ int lengthCode = static_cast<int>(std::upper_bound(lengthBases, lengthBases + 29, length) - lengthBases) - 1;
+ writeFixedLiteral(writer, 257 + lengthCode);
+ writer.writeBits(length - lengthBases[lengthCode], lengthExtraBits[lengthCode]);
+ int distanceCode = static_cast<int>(std::upper_bound(distanceBases, distanceBases + 30, distance) - distanceBases) - 1;
+ writer.writeCode(distanceCode, 5);
+ writer.writeBits(distance - distanceBases[distanceCode], distanceExtraBits[distanceCode]);
+}
+
+// Compresses data into a zlib stream of one deflate block with the fixed Huffman codes.
+// Matches are found through a table of the last position of each 3 byte hash, which
+// suits the flat areas of viewport captures.
+void compressZlib(const std::vector<unsigned char>& data, std::vector<unsigned char>& out)
+{
+ const size_t windowSize = 32768;
+ const size_t maxMatch = 258;
+ out.clear();
+ out.push_back(0x78);
+ out.push_back(0x01);
+
+ DeflateBitWriter writer(out);
+ writer.writeBits(1, 1);
+ writer.writeBits(1, 2);
+ std::vector<int64_t> table(1 << 15, -1);
+ size_t size = data.size();
+ size_t position = 0;
+ while (position < size)
+ {
+  size_t length = 0;
+  size_t distance = 0;
+  if (position + 3 <= size)
+  {
+   uint32_t hash = ((data[position] << 16 | data[position + 1] << 8 | data[position + 2]) * 2654435761U) >> 17;
+   int64_t candidate = table[hash];
+   table[hash] = static_cast<int64_t>(position);
+   if (candidate >= 0 && position - candidate <= windowSize)
+   {
+    size_t limit = std::min(maxMatch, size - position);
+    while (length < limit && data[candidate + length] == data[position + length])
+     ++length;
+    distance = position - static_cast<size_t>(candidate);
+   }
+  }
+
+  if (length >= 3)
+  {
+   writeFixedMatch(writer, static_cast<int>(length), static_cast<int>(distance));
+   for (size_t i = 1; i < length && position + i + 3 <= size; ++i)
+   {
+    size_t next = position + i;
+    table[((data[next] << 16 | data[next + 1] << 8 | data[next + 2]) * 2654435761U) >> 17] = static_cast<int64_t>(next);
+   }
+   position += length;
+  }
+  else
+  {
+   writeFixedLiteral(writer, data[position]);
+   ++position;
+  }
+ }
+ writeFixedLiteral(writer, 256);
+ writer.flush();
+
+ uint32_t a = 1, b = 0;
+ for (size_t i = 0; i < size; ++i)
+ {
+  a = (a + data[i]) % 65521;
+  b = (b + a) % 65521;
+ }
+ uint32_t adler = (b << 16) | a;
+ for (int i = 3; i >= 0; --i)
+  out.push_back(static_cast<unsigned char>(adler >> (8 * i)));
+}
+
+uint32_t getCrc32(const unsigned char* data, size_t size, uint32_t crc = 0)
+{
+ static uint32_t table[256];
+ static std::once_flag tableFlag;
+ std::call_once(tableFlag, []
+ {
+  for (uint32_t i = 0; i < 256; ++i)
+  {
+   uint32_t value = i;
+   for (int bit = 0; bit < 8; ++bit)
+    value = (value & 1) ? 0xEDB88320U ^ (value >> 1) : value >> 1;
+   table[i] = value;
+  }
+ });
+ crc = ~crc;
+ for (size_t i = 0; i < size; ++i)
+  crc = table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+ return ~crc;
+}
+
+void appendPngChunk(std::vector<unsigned char>& png, const char* type, const std::vector<unsigned char>& data)
+{
+ uint32_t size = static_cast<uint32_t>(data.size());
+ for (int i = 3; i >= 0; --i)
+  png.push_back(static_cast<unsigned char>(size >> (8 * i)));
+ size_t typeStart = png.size();
+ png.insert(png.end(), type, type + 4);
+ png.insert(png.end(), data.begin(), data.end());
+ uint32_t crc = getCrc32(&png[typeStart], png.size() - typeStart);
+ for (int i = 3; i >= 0; --i)
+  png.push_back(static_cast<unsigned char>(crc >> (8 * i)));
+}
+
+// Writes an RGB PNG, filtering each row with whichever of the five PNG filters gives the
+// smallest sum of absolute differences.
+bool writePngFile(const std::string& filePath, const RgbImage& image)
+{
+ size_t stride = static_cast<size_t>(image.width) * 3;
+ std::vector<unsigned char> filtered;
+ filtered.reserve((stride + 1) * image.height);
+ std::vector<unsigned char> zeroRow(stride, 0);
+ std::vector<unsigned char> candidate(stride);
+ std::vector<unsigned char> best(stride);
+ for (int y = 0; y < image.height; ++y)
+ {
+  const unsigned char* row = &image.pixels[y * stride];
+  const unsigned char* above = y > 0 ? row - stride : zeroRow.data();
+  uint64_t bestCost = UINT64_MAX;
+  unsigned char bestFilter = 0;
+  for (unsigned char filter = 0; filter < 5; ++filter)
+  {
+   uint64_t cost = 0;
+   for (size_t x = 0; x < stride; ++x)
+   {
+    int left = x >= 3 ? row[x - 3] : 0;
+    int up = above[x];
+    int upLeft = x >= 3 ? above[x - 3] : 0;
+    int predictor = 0;
+    if (filter == 1)
+     predictor = left;
+    else if (filter == 2)
+     predictor = up;
+    else if (filter == 3)
+     predictor = (left + up) / 2;
+    else if (filter == 4)
+    {
+     int estimate = left + up - upLeft;
+     int leftDistance = abs(estimate - left), upDistance = abs(estimate - up), upLeftDistance = abs(estimate - upLeft);
+     predictor = leftDistance <= upDistance && leftDistance <= upLeftDistance ? left : (upDistance <= upLeftDistance ? up : upLeft);
+    }
+    candidate[x] = static_cast<unsigned char>(row[x] - predictor);
+    cost += static_cast<signed char>(candidate[x]) < 0 ? 256 - candidate[x] : candidate[x];
+   }
+   if (cost < bestCost)
+   {
+    bestCost = cost;
+    bestFilter = filter;
+    best.swap(candidate);
+   }
+  }
+  filtered.push_back(bestFilter);
+  filtered.insert(filtered.end(), best.begin(), best.end());
+ }
+
+ std::vector<unsigned char> png = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+ std::vector<unsigned char> header(13, 0);
+ for (int i = 0; i < 4; ++i)
+ {
+  header[3 - i] = static_cast<unsigned char>(image.width >> (8 * i));
+  header[7 - i] = static_cast<unsigned char>(image.height >> (8 * i));
+ }
+ header[8] = 8;
+ header[9] = 2;
+ appendPngChunk(png, "IHDR", header);
+ std::vector<unsigned char> compressed;
+ compressZlib(filtered, compressed);
+ appendPngChunk(png, "IDAT", compressed);
+ appendPngChunk(png, "IEND", std::vector<unsigned char>());
+
+ std::ofstream file(filePath.c_str(), std::ios::binary | std::ios::trunc);
+ file.write(reinterpret_cast<const char*>(png.data()), png.size());
+ return file.good();
+}
+
+bool copyFile(const std::string& sourcePath, const std::string& targetPath)
+{
+ std::ifstream source(sourcePath.c_str(), std::ios::binary);
+ std::ofstream target(targetPath.c_str(), std::ios::binary | std::ios::trunc);
+ if (!source || !target)
+  return false;
+ target << source.rdbuf();
+ return target.good();
+}
+
+// Pool of threads running tasks that only touch files, so the main thread can go on
+// with the next frame while the earlier ones are encoded.
+class FrameWorkerPool
+{
+public:
+ explicit FrameWorkerPool(size_t threadCount)
+ {
+  for (size_t i = 0; i < threadCount; ++i)
+   m_threads.push_back(std::thread(&FrameWorkerPool::work, this));
+ }
+
+ ~FrameWorkerPool()
+ {
+  {
+   std::lock_guard<std::mutex> lock(m_mutex);
+   m_isStopping = true;
+  }
+  m_taskAdded.notify_all();
+  for (size_t i = 0; i < m_threads.size(); ++i)
+   m_threads[i].join();
+ }
+
+ void submit(const std::function<bool()>& task)
+ {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  m_tasks.push(task);
+  ++m_pendingCount;
+  m_taskAdded.notify_one();
+ }
+
+ size_t pendingCount()
+ {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  return m_pendingCount;
+ }
+
+ size_t failedCount()
+ {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  return m_failedCount;
+ }
+
+private:
+ void work()
+ {
+  for (;;)
+  {
+   std::function<bool()> task;
+   {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_taskAdded.wait(lock, [this] { return m_isStopping || !m_tasks.empty(); });
+    if (m_tasks.empty())
+     return;
+    task = m_tasks.front();
+    m_tasks.pop();
+   }
+   bool isDone = task();
+   std::lock_guard<std::mutex> lock(m_mutex);
+   --m_pendingCount;
+   if (!isDone)
+    ++m_failedCount;
+  }
+ }
+
+ std::vector<std::thread> m_threads;
+ std::mutex m_mutex;
+ std::condition_variable m_taskAdded;
+ std::queue<std::function<bool()>> m_tasks;
+ size_t m_pendingCount = 0;
+ size_t m_failedCount = 0;
+ bool m_isStopping = false;
+};
+
+// Keeps Fusion responsive while waiting for the pool to have at most maxPending tasks.
+void waitForWorkers(FrameWorkerPool& pool, size_t maxPending)
+{
+ while (pool.pendingCount() > maxPending)
+ {
+  adsk::doEvents();
+  std::this_thread::sleep_for(std::chrono::milliseconds(5));
+ }
+}
+
 extern "C" XI_EXPORT bool run(const char* context)
 {
  app = Application::get();
@@ -56,6 +468,19 @@ extern "C" XI_EXPORT bool run(const char* context)
   return false;
  }
 
+ // Capture each frame as an uncompressed BMP, which the viewport writes quickly, and
+ // let the workers encode it to PNG while the next frame computes. A frame whose pixels
+ // match the frame before it is not encoded; its image is copied once the encoding is
+ // done. Hashing the pixels sees any visible change, such as a hole sliding along a
+ // plate, which leaves the area, volume and bounding box of the body unchanged.
+ size_t threadCount = std::max(1U, std::min(8U, std::thread::hardware_concurrency() - 1));
+ FrameWorkerPool pool(threadCount);
+ std::vector<std::pair<std::string, std::string>> reusedFrames;
+ uint64_t lastSignature = 0;
+ std::string lastFrame;
+ double captureSeconds = 0;
+ std::chrono::steady_clock::time_point startTime = std::chrono::steady_clock::now();
+
  double currentValue = startValue;
  param->value(currentValue);
 
@@ -66,11 +491,61 @@ extern "C" XI_EXPORT bool run(const char* context)
   adsk::doEvents();
   currentValue += increment;
   std::string filename = resultFolder + "frame" + pad(cnt, 4);
-  app->activeViewport()->saveAsImageFile(filename, 0, 0);
   cnt += 1;
+
+  // Bound the images waiting in memory when encoding falls behind.
+  waitForWorkers(pool, threadCount * 2);
+  std::chrono::steady_clock::time_point captureStartTime = std::chrono::steady_clock::now();
+  if (!app->activeViewport()->saveAsImageFile(filename + ".bmp", 0, 0))
+  {
+   ui->messageBox("Unable to save \"" + filename + ".bmp\".");
+   return false;
+  }
+  captureSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - captureStartTime).count();
+
+  std::shared_ptr<RgbImage> image = std::make_shared<RgbImage>();
+  if (!readBmpFile(filename + ".bmp", *image))
+  {
+   ui->messageBox("Unable to read \"" + filename + ".bmp\".");
+   return false;
+  }
+  uint64_t signature = hashBytes(image->pixels.data(), image->pixels.size());
+  signature = hashBytes(&image->width, sizeof(image->width), hashBytes(&image->height, sizeof(image->height), signature));
+  if (!lastFrame.empty() && signature == lastSignature)
+  {
+   std::remove((filename + ".bmp").c_str());
+   reusedFrames.push_back(std::make_pair(lastFrame, filename + ".png"));
+   continue;
+  }
+
+  pool.submit([filename, image]
+  {
+   bool isEncoded = writePngFile(filename + ".png", *image);
+   if (isEncoded)
+    std::remove((filename + ".bmp").c_str());
+   return isEncoded;
+  });
+  lastSignature = signature;
+  lastFrame = filename + ".png";
+ }
+ double loopSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+
+ waitForWorkers(pool, 0);
+ for (size_t i = 0; i < reusedFrames.size(); ++i)
+ {
+  std::pair<std::string, std::string> frame = reusedFrames[i];
+  pool.submit([frame] { return copyFile(frame.first, frame.second); });
  }
+ waitForWorkers(pool, 0);
+ double totalSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
 
- ui->messageBox("Finished.");
+ std::stringstream message;
+ message << "Finished " << cnt << " frames, " << reusedFrames.size() << " reused from the frame before.";
+ if (pool.failedCount() > 0)
+  message << " " << pool.failedCount() << " frames failed to encode or copy; an unencoded frame is left as BMP.";
+ message << "\nFrames took " << loopSeconds << " s, " << captureSeconds << " s of it capturing. Encoding finished "
+  << totalSeconds - loopSeconds << " s after the last frame.";
+ ui->messageBox(message.str());
 
  return true;
 }
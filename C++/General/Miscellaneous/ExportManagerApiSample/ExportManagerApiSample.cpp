@@ -1,6 +1,8 @@
 #include <Core/Application/Application.h>
 #include <Core/UserInterface/UserInterface.h>
+#include <Core/UserInterface/ProgressDialog.h>
 #include <Core/Application/Document.h>
+#include <Core/Utils.h>
 
 #include <Fusion/Fusion/Design.h>
 #include <Fusion/Fusion/ExportManager.h>
@@ -13,6 +15,20 @@
 #include <Fusion/Components/Components.h>
 #include <Fusion/Components/Component.h>
 
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#ifndef XI_WIN
+#include <dlfcn.h>
+#endif
 
 using namespace adsk::core;
 using namespace adsk::fusion;
@@ -21,6 +37,363 @@ Ptr<UserInterface> ui;
 
 std::string getDllPath();
 
+// Gets the 64 bit FNV-1a hash of the bytes.
+uint64_t hashBytes(const char* data, size_t size, uint64_t hash = 14695981039346656037ULL)
+{
+ for (size_t i = 0; i < size; ++i)
+ {
+  hash ^= static_cast<unsigned char>(data[i]);
+  hash *= 1099511628211ULL;
+ }
+ return hash;
+}
+
+uint64_t hashString(const std::string& text)
+{
+ return hashBytes(text.data(), text.size());
+}
+
+// Gets the hash of the content of a file, reading it in blocks.
+bool getFileChecksum(const std::string& filePath, uint64_t& checksum)
+{
+ std::ifstream file(filePath.c_str(), std::ios::binary);
+ if (!file)
+  return false;
+ checksum = 14695981039346656037ULL;
+ std::vector<char> buffer(1 << 16);
+ while (file)
+ {
+  file.read(buffer.data(), buffer.size());
+  checksum = hashBytes(buffer.data(), static_cast<size_t>(file.gcount()), checksum);
+ }
+ return file.eof();
+}
+
+// Output of one export of a component, as recorded in the manifest.
+struct ExportRecord
+{
+ std::string revisionId;
+ uint64_t optionsHash = 0;
+ std::string outputPath;
+ uint64_t checksum = 0;
+};
+
+// Manifest of the exports made by earlier runs, keyed by component id and format. The
+// component id is used rather than the entity token, which is not stable between sessions.
+class IncrementalExportManifest
+{
+public:
+ bool load(const std::string& filePath)
+ {
+  m_records.clear();
+  std::ifstream file(filePath.c_str());
+  if (!file)
+   return false;
+
+  std::string line;
+  while (std::getline(file, line))
+  {
+   std::vector<std::string> fields;
+   std::stringstream lineStream(line);
+   std::string field;
+   while (std::getline(lineStream, field, '\t'))
+    fields.push_back(field);
+   if (fields.size() != 6)
+    continue;
+
+   ExportRecord record;
+   record.revisionId = fields[2];
+   record.optionsHash = strtoull(fields[3].c_str(), nullptr, 16);
+   record.checksum = strtoull(fields[4].c_str(), nullptr, 16);
+   record.outputPath = fields[5];
+   m_records[std::make_pair(fields[0], fields[1])] = record;
+  }
+  return true;
+ }
+
+ bool save(const std::string& filePath) const
+ {
+  std::ofstream file(filePath.c_str(), std::ios::trunc);
+  if (!file)
+   return false;
+  for (std::map<std::pair<std::string, std::string>, ExportRecord>::const_iterator it = m_records.begin(); it != m_records.end(); ++it)
+  {
+   file << it->first.first << "\t" << it->first.second << "\t" << it->second.revisionId << "\t" << std::hex << it->second.optionsHash << "\t"
+    << it->second.checksum << std::dec << "\t" << it->second.outputPath << "\n";
+  }
+  return file.good();
+ }
+
+ // Checks whether the last export of the component in the format was made from the same
+ // revision and options and its output is still on disk. With verifyChecksum, the output
+ // must also be unchanged since it was exported.
+ bool isUpToDate(const std::string& componentId, const std::string& format, const std::string& revisionId, uint64_t optionsHash, bool verifyChecksum) const
+ {
+  std::map<std::pair<std::string, std::string>, ExportRecord>::const_iterator found = m_records.find(std::make_pair(componentId, format));
+  if (found == m_records.end() || found->second.revisionId != revisionId || found->second.optionsHash != optionsHash)
+   return false;
+  if (verifyChecksum)
+  {
+   uint64_t checksum = 0;
+   return getFileChecksum(found->second.outputPath, checksum) && checksum == found->second.checksum;
+  }
+  return std::ifstream(found->second.outputPath.c_str()).good();
+ }
+
+ // Records an export, hashing its output.
+ bool record(const std::string& componentId, const std::string& format, const std::string& revisionId, uint64_t optionsHash, const std::string& outputPath)
+ {
+  ExportRecord record;
+  record.revisionId = revisionId;
+  record.optionsHash = optionsHash;
+  record.outputPath = outputPath;
+  if (!getFileChecksum(outputPath, record.checksum))
+   return false;
+  m_records[std::make_pair(componentId, format)] = record;
+  return true;
+ }
+
+private:
+ std::map<std::pair<std::string, std::string>, ExportRecord> m_records;
+};
+
+struct IncrementalExportStats
+{
+ size_t exportedCount = 0;
+ size_t skippedCount = 0;
+ size_t failedCount = 0;
+};
+
+enum ExportJobStatus
+{
+ ExportJobExported = 'e',
+ ExportJobSkipped = 's',
+ ExportJobFailed = 'f'
+};
+
+// Gets the hash of the values set on the export options: the format, the file, the
+// exported component and the settings of the format.
+uint64_t getExportOptionsHash(const std::string& format, const Ptr<ExportOptions>& options)
+{
+ std::stringstream values;
+ values << format << "\t" << options->filename();
+ Ptr<Component> geometry = options->geometry();
+ if (geometry)
+  values << "\t" << geometry->id();
+ Ptr<SMTExportOptions> smtOptions = options;
+ if (smtOptions)
+  values << "\t" << smtOptions->version();
+ return hashString(values.str());
+}
+
+// Exports the component with the options unless the manifest shows the same revision
+// was already exported with the same options.
+ExportJobStatus exportIfChanged(const Ptr<ExportManager>& exportMgr, const Ptr<ExportOptions>& options, const Ptr<Component>& comp, const std::string& format,
+ const std::string& outputPath, IncrementalExportManifest& manifest, IncrementalExportStats& stats)
+{
+ if (!options)
+ {
+  ++stats.failedCount;
+  return ExportJobFailed;
+ }
+
+ uint64_t optionsHash = getExportOptionsHash(format, options);
+ std::string componentId = comp->id();
+ std::string revisionId = comp->revisionId();
+ if (manifest.isUpToDate(componentId, format, revisionId, optionsHash, false))
+ {
+  ++stats.skippedCount;
+  return ExportJobSkipped;
+ }
+
+ if (exportMgr->execute(options) && manifest.record(componentId, format, revisionId, optionsHash, outputPath))
+ {
+  ++stats.exportedCount;
+  return ExportJobExported;
+ }
+ ++stats.failedCount;
+ return ExportJobFailed;
+}
+
+// Creates the default options of a format, or null if the format is unknown.
+Ptr<ExportOptions> createExportOptions(const Ptr<ExportManager>& exportMgr, const std::string& format, const std::string& outputPath, const Ptr<Component>& comp)
+{
+ if (format == "iges")
+  return exportMgr->createIGESExportOptions(outputPath, comp);
+ if (format == "sat")
+  return exportMgr->createSATExportOptions(outputPath, comp);
+ if (format == "smt")
+  return exportMgr->createSMTExportOptions(outputPath, comp);
+ if (format == "step")
+  return exportMgr->createSTEPExportOptions(outputPath, comp);
+ if (format == "f3d")
+  return exportMgr->createFusionArchiveExportOptions(outputPath, comp);
+ return nullptr;
+}
+
+// One export of a component to a file.
+struct ExportJob
+{
+ std::string componentId;
+ std::string format;
+ std::string outputPath;
+};
+
+// Time spent on the jobs of one format.
+struct ExportFormatTiming
+{
+ size_t count = 0;
+ double totalSeconds = 0;
+ double maxSeconds = 0;
+
+ void add(double seconds)
+ {
+  ++count;
+  totalSeconds += seconds;
+  if (seconds > maxSeconds)
+   maxSeconds = seconds;
+ }
+};
+
+// Queue of export jobs kept on disk. The job list is written once when the queue is
+// created and each finished job is appended to a journal, so a run that is cancelled or
+// interrupted resumes from the first job the journal does not list. The job list starts
+// with the id and name of the design it was made for, as its jobs only make sense there.
+class ExportJobQueue
+{
+public:
+ ExportJobQueue(const std::string& jobsPath, const std::string& journalPath)
+  : m_jobsPath(jobsPath), m_journalPath(journalPath)
+ {
+ }
+
+ // Loads the queue left by an earlier run and the jobs it finished.
+ bool load()
+ {
+  m_jobs.clear();
+  m_isDone.clear();
+  m_doneCount = 0;
+  m_timings.clear();
+  m_designId.clear();
+  m_designName.clear();
+
+  std::ifstream jobsFile(m_jobsPath.c_str());
+  if (!jobsFile)
+   return false;
+  std::string line;
+  if (!std::getline(jobsFile, line))
+   return false;
+  std::vector<std::string> designFields = splitLine(line);
+  if (designFields.size() != 3 || designFields[0] != "design")
+   return false;
+  m_designId = designFields[1];
+  m_designName = designFields[2];
+  while (std::getline(jobsFile, line))
+  {
+   std::vector<std::string> fields = splitLine(line);
+   if (fields.size() != 3)
+    continue;
+   ExportJob job;
+   job.componentId = fields[0];
+   job.format = fields[1];
+   job.outputPath = fields[2];
+   m_jobs.push_back(job);
+  }
+  m_isDone.assign(m_jobs.size(), false);
+
+  // A line cut short by an interruption does not parse and its job runs again.
+  std::ifstream journalFile(m_journalPath.c_str());
+  while (journalFile && std::getline(journalFile, line))
+  {
+   std::vector<std::string> fields = splitLine(line);
+   if (fields.size() != 3 || fields[1].size() != 1)
+    continue;
+   size_t index = static_cast<size_t>(strtoull(fields[0].c_str(), nullptr, 10));
+   if (index >= m_jobs.size() || m_isDone[index])
+    continue;
+   m_isDone[index] = true;
+   ++m_doneCount;
+   if (fields[1][0] == ExportJobExported)
+    m_timings[m_jobs[index].format].add(strtod(fields[2].c_str(), nullptr));
+  }
+  return !m_jobs.empty();
+ }
+
+ // Starts a new queue with the jobs of a design, replacing any earlier one.
+ bool create(const std::string& designId, const std::string& designName, const std::vector<ExportJob>& jobs)
+ {
+  std::remove(m_journalPath.c_str());
+  std::ofstream jobsFile(m_jobsPath.c_str(), std::ios::trunc);
+  if (!jobsFile)
+   return false;
+  jobsFile << "design\t" << designId << "\t" << designName << "\n";
+  for (size_t i = 0; i < jobs.size(); ++i)
+   jobsFile << jobs[i].componentId << "\t" << jobs[i].format << "\t" << jobs[i].outputPath << "\n";
+  jobsFile.close();
+  if (!jobsFile)
+   return false;
+
+  m_designId = designId;
+  m_designName = designName;
+  m_jobs = jobs;
+  m_isDone.assign(m_jobs.size(), false);
+  m_doneCount = 0;
+  m_timings.clear();
+  return true;
+ }
+
+ // Records a finished job. The journal is flushed each time, so it survives a crash.
+ bool complete(size_t index, ExportJobStatus status, double seconds)
+ {
+  if (index >= m_jobs.size() || m_isDone[index])
+   return false;
+  m_isDone[index] = true;
+  ++m_doneCount;
+  if (status == ExportJobExported)
+   m_timings[m_jobs[index].format].add(seconds);
+
+  std::ofstream journalFile(m_journalPath.c_str(), std::ios::app);
+  journalFile << index << "\t" << static_cast<char>(status) << "\t" << seconds << "\n";
+  journalFile.flush();
+  return journalFile.good();
+ }
+
+ // Removes the queue from disk once all of its jobs are done.
+ void clear()
+ {
+  std::remove(m_jobsPath.c_str());
+  std::remove(m_journalPath.c_str());
+ }
+
+ const std::string& designId() const { return m_designId; }
+ const std::string& designName() const { return m_designName; }
+ size_t count() const { return m_jobs.size(); }
+ size_t doneCount() const { return m_doneCount; }
+ bool isDone(size_t index) const { return m_isDone[index]; }
+ const ExportJob& job(size_t index) const { return m_jobs[index]; }
+ const std::map<std::string, ExportFormatTiming>& timings() const { return m_timings; }
+
+private:
+ static std::vector<std::string> splitLine(const std::string& line)
+ {
+  std::vector<std::string> fields;
+  std::stringstream lineStream(line);
+  std::string field;
+  while (std::getline(lineStream, field, '\t'))
+   fields.push_back(field);
+  return fields;
+ }
+
+ std::string m_jobsPath;
+ std::string m_journalPath;
+ std::string m_designId;
+ std::string m_designName;
+ std::vector<ExportJob> m_jobs;
+ std::vector<bool> m_isDone;
+ size_t m_doneCount = 0;
+ std::map<std::string, ExportFormatTiming> m_timings;
+};
+
 extern "C" XI_EXPORT bool run(const char* context)
 {
  Ptr<Application> app = Application::get();
@@ -51,40 +424,140 @@ extern "C" XI_EXPORT bool run(const char* context)
  if (!exportMgr)
   return false;
 
- // export the component one by one with a specified format
+ // look up the components by id, as the queue refers to them
+ std::map<std::string, Ptr<Component>> compsById;
  size_t count = comps->count();
  for (size_t index = 0; index < count; ++index)
  {
   Ptr<Component> comp = comps->item(index);
-  std::string name = comp->name();
-  std::string fileName = getDllPath() + "/" + name;
+  if (comp)
+   compsById[comp->id()] = comp;
+ }
+
+ // resume the queue an earlier run left, or queue each component with each format
+ // the root component id identifies the design; its name only helps the user find it
+ Ptr<Component> rootComp = design->rootComponent();
+ if (!rootComp)
+  return false;
+ std::string designId = rootComp->id();
+ std::string designName = rootComp->name();
+ Ptr<Document> doc = design->parentDocument();
+ if (doc)
+  designName = doc->name();
+
+ ExportJobQueue queue(getDllPath() + "/" + "ExportJobs.txt", getDllPath() + "/" + "ExportJobs.done");
+ bool isResumed = queue.load();
+ if (isResumed && queue.designId() != designId)
+ {
+  // the queue belongs to another design: its jobs would all fail here
+  std::stringstream question;
+  question << "An export of " << queue.designName() << " was left with " << queue.count() - queue.doneCount()
+   << " exports to do. Open that design to resume it.\n\nDiscard it and export " << designName << " instead?";
+  if (ui->messageBox(question.str(), "Export", MessageBoxButtonTypes::YesNoButtonType, MessageBoxIconTypes::WarningIconType) != DialogResults::DialogYes)
+   return true;
+  isResumed = false;
+ }
+ if (!isResumed)
+ {
+  const char* formats[] = { "iges", "sat", "smt", "step", "f3d" };
+  const char* extensions[] = { ".igs", ".sat", ".smt", ".step", ".f3d" };
+  std::vector<ExportJob> jobs;
+  for (size_t index = 0; index < count; ++index)
+  {
+   Ptr<Component> comp = comps->item(index);
+   if (!comp) continue;
+   // components can share a name, so the file name also holds a hash of the id
+   std::stringstream fileName;
+   fileName << getDllPath() << "/" << comp->name() << "_" << std::hex << std::setw(16) << std::setfill('0') << hashString(comp->id());
+   for (size_t formatIndex = 0; formatIndex < 5; ++formatIndex)
+   {
+    ExportJob job;
+    job.componentId = comp->id();
+    job.format = formats[formatIndex];
+    job.outputPath = fileName.str() + extensions[formatIndex];
+    jobs.push_back(job);
+   }
+  }
+  if (!queue.create(designId, designName, jobs))
+   return false;
+ }
 
-  // export the component with IGS format
-  Ptr<IGESExportOptions> igesOptions = exportMgr->createIGESExportOptions(fileName, comp);
-  if (!igesOptions) continue;
-  exportMgr->execute(igesOptions);
+ Ptr<ProgressDialog> progressDialog = ui->createProgressDialog();
+ if (!progressDialog)
+  return false;
+ progressDialog->cancelButtonText("Cancel");
+ progressDialog->isBackgroundTranslucent(false);
+ progressDialog->isCancelButtonShown(true);
+ progressDialog->show("Export", "Exported %v of %m", 0, static_cast<int>(queue.count()), 1);
+ progressDialog->progressValue(static_cast<int>(queue.doneCount()));
 
-  // export the component with SAT format
-  Ptr<SATExportOptions> satOptions = exportMgr->createSATExportOptions(fileName, comp);
-  if (!satOptions) continue;
-  exportMgr->execute(satOptions);
+ // run the jobs one at a time, skipping the exports that are up to date and letting
+ // Fusion process its events between jobs
+ std::string manifestPath = getDllPath() + "/" + "ExportManifest.txt";
+ IncrementalExportManifest manifest;
+ manifest.load(manifestPath);
+ IncrementalExportStats stats;
+ std::chrono::steady_clock::time_point startTime = std::chrono::steady_clock::now();
 
-  // export the component with SMT format
-  Ptr<SMTExportOptions> smtOptions = exportMgr->createSMTExportOptions(fileName, comp);
-  if (!smtOptions) continue;
-  exportMgr->execute(smtOptions);
+ bool wasCancelled = false;
+ size_t runCount = 0;
+ for (size_t index = 0; index < queue.count(); ++index)
+ {
+  if (queue.isDone(index))
+   continue;
+  if (progressDialog->wasCancelled())
+  {
+   wasCancelled = true;
+   break;
+  }
+
+  const ExportJob& job = queue.job(index);
+  std::chrono::steady_clock::time_point jobStartTime = std::chrono::steady_clock::now();
+  ExportJobStatus status = ExportJobFailed;
+  std::map<std::string, Ptr<Component>>::const_iterator found = compsById.find(job.componentId);
+  if (found != compsById.end())
+  {
+   Ptr<ExportOptions> options = createExportOptions(exportMgr, job.format, job.outputPath, found->second);
+   status = exportIfChanged(exportMgr, options, found->second, job.format, job.outputPath, manifest, stats);
+  }
+  else
+  {
+   ++stats.failedCount;
+  }
+  double jobSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - jobStartTime).count();
 
-  // export the component with STP format
-  Ptr<STEPExportOptions> stepOptions = exportMgr->createSTEPExportOptions(fileName, comp);
-  if (!stepOptions) continue;
-  exportMgr->execute(stepOptions);
+  // the journal is written after every job; the manifest only every 50 jobs, as it is
+  // rewritten whole. An interruption costs at most a re-export in a later run.
+  queue.complete(index, status, jobSeconds);
+  if (++runCount % 50 == 0)
+   manifest.save(manifestPath);
 
-  // export the component with F3D format
-  Ptr<FusionArchiveExportOptions> archOptions = exportMgr->createFusionArchiveExportOptions(fileName, comp);
-  if (!stepOptions) continue;
-  exportMgr->execute(archOptions);
+  progressDialog->progressValue(static_cast<int>(queue.doneCount()));
+  adsk::doEvents();
  }
+ manifest.save(manifestPath);
+ progressDialog->hide();
 
+ double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+ std::stringstream message;
+ if (isResumed)
+  message << "Resumed an earlier export.\n";
+ message << "Exported " << stats.exportedCount << ", skipped " << stats.skippedCount << " unchanged, failed " << stats.failedCount << " in " << seconds << " s.";
+ const std::map<std::string, ExportFormatTiming>& timings = queue.timings();
+ for (std::map<std::string, ExportFormatTiming>::const_iterator it = timings.begin(); it != timings.end(); ++it)
+ {
+  message << "\n" << it->first << ": " << it->second.count << " exports, " << std::fixed << std::setprecision(2)
+   << it->second.totalSeconds / it->second.count << " s average, " << it->second.maxSeconds << " s longest" << std::defaultfloat;
+ }
+ if (wasCancelled)
+ {
+  message << "\nCancelled with " << queue.count() - queue.doneCount() << " exports left. Run again to resume.";
+ }
+ else
+ {
+  queue.clear();
+ }
+ ui->messageBox(message.str());
 
  return true;
 }
@@ -1,3 +1,4 @@
+#include <Core/Utils.h>
 #include <Core/Application/Application.h>
 #include <Core/Application/Documents.h>
 #include <Core/Application/Document.h>
@@ -29,6 +30,29 @@
 #include <Fusion/Fusion/STEPExportOptions.h>
 #include <Fusion/Fusion/STLExportOptions.h>
 
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <fstream>
+#include <iomanip>
+#include <mutex>
+#include <queue>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#if defined(_WINDOWS) || defined(_WIN32) || defined(_WIN64)
+#include <direct.h>
+#else
+#include <dlfcn.h>
+#include <sys/stat.h>
+#endif
 
 using namespace adsk::core;
 using namespace adsk::fusion;
@@ -37,6 +61,425 @@ Ptr<UserInterface> ui;
 
 std::string getDllPath();
 
+bool makeDirectory(const std::string& path)
+{
+#if defined(_WINDOWS) || defined(_WIN32) || defined(_WIN64)
+ return _mkdir(path.c_str()) == 0 || errno == EEXIST;
+#else
+ return mkdir(path.c_str(), 0755) == 0 || errno == EEXIST;
+#endif
+}
+
+uint32_t readUInt32(const unsigned char* data)
+{
+ uint32_t value;
+ memcpy(&value, data, sizeof(value));
+ return value;
+}
+
+void appendUInt32(std::vector<unsigned char>& out, uint32_t value)
+{
+ for (int i = 0; i < 4; ++i)
+  out.push_back(static_cast<unsigned char>(value >> (8 * i)));
+}
+
+uint32_t rotateLeft(uint32_t value, int count)
+{
+ return (value << count) | (value >> (32 - count));
+}
+
+// Streaming SHA-256.
+class Sha256
+{
+public:
+ Sha256()
+ {
+  static const uint32_t initialState[8] = { 0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19 };
+  memcpy(m_state, initialState, sizeof(m_state));
+ }
+
+ void update(const unsigned char* data, size_t size)
+ {
+  m_totalSize += size;
+  while (size > 0)
+  {
+   size_t count = std::min(size, sizeof(m_block) - m_blockSize);
+   memcpy(m_block + m_blockSize, data, count);
+   m_blockSize += count;
+   data += count;
+   size -= count;
+   if (m_blockSize == sizeof(m_block))
+   {
+    transform(m_block);
+    m_blockSize = 0;
+   }
+  }
+ }
+
+ // Gets the digest as lower case hex. The object is spent afterwards.
+ std::string finish()
+ {
+  uint64_t bitCount = m_totalSize * 8;
+  unsigned char padding[72] = { 0x80 };
+  size_t paddingSize = (m_blockSize < 56 ? 56 : 120) - m_blockSize;
+  for (int i = 0; i < 8; ++i)
+   padding[paddingSize + i] = static_cast<unsigned char>(bitCount >> (56 - 8 * i));
+  update(padding, paddingSize + 8);
+
+  std::stringstream digest;
+  for (int i = 0; i < 8; ++i)
+   digest << std::hex << std::setw(8) << std::setfill('0') << m_state[i];
+  return digest.str();
+ }
+
+private:
+ static uint32_t rotateRight(uint32_t value, int count)
+ {
+  return (value >> count) | (value << (32 - count));
+ }
+
+ void transform(const unsigned char* block)
+ {
+  static const uint32_t k[64] = {
+   0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+   0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+   0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+   0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+   0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+   0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+   0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+   0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2 };
+
+  uint32_t w[64];
+  for (int i = 0; i < 16; ++i)
+   w[i] = (uint32_t(block[4 * i]) << 24) | (uint32_t(block[4 * i + 1]) << 16) | (uint32_t(block[4 * i + 2]) << 8) | block[4 * i + 3];
+  for (int i = 16; i < 64; ++i)
+  {
+   uint32_t s0 = rotateRight(w[i - 15], 7) ^ rotateRight(w[i - 15], 18) ^ (w[i - 15] >> 3);
+   uint32_t s1 = rotateRight(w[i - 2], 17) ^ rotateRight(w[i - 2], 19) ^ (w[i - 2] >> 10);
+   w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+  }
+
+  uint32_t a = m_state[0], b = m_state[1], c = m_state[2], d = m_state[3];
+  uint32_t e = m_state[4], f = m_state[5], g = m_state[6], h = m_state[7];
+  for (int i = 0; i < 64; ++i)
+  {
+   uint32_t s1 = rotateRight(e, 6) ^ rotateRight(e, 11) ^ rotateRight(e, 25);
+   uint32_t temp1 = h + s1 + ((e & f) ^ (~e & g)) + k[i] + w[i];
+   uint32_t s0 = rotateRight(a, 2) ^ rotateRight(a, 13) ^ rotateRight(a, 22);
+   uint32_t temp2 = s0 + ((a & b) ^ (a & c) ^ (b & c));
+   h = g;
+   g = f;
+   f = e;
+   e = d + temp1;
+   d = c;
+   c = b;
+   b = a;
+   a = temp1 + temp2;
+  }
+  m_state[0] += a; m_state[1] += b; m_state[2] += c; m_state[3] += d;
+  m_state[4] += e; m_state[5] += f; m_state[6] += g; m_state[7] += h;
+ }
+
+ uint32_t m_state[8];
+ unsigned char m_block[64];
+ size_t m_blockSize = 0;
+ uint64_t m_totalSize = 0;
+};
+
+// Gets the 32 bit xxHash of a few bytes, as the LZ4 frame header checksum needs.
+uint32_t getShortXxHash32(const unsigned char* data, size_t size)
+{
+ const uint32_t prime1 = 2654435761U, prime2 = 2246822519U, prime3 = 3266489917U, prime4 = 668265263U, prime5 = 374761393U;
+ uint32_t hash = prime5 + static_cast<uint32_t>(size);
+ for (; size >= 4; data += 4, size -= 4)
+  hash = rotateLeft(hash + readUInt32(data) * prime3, 17) * prime4;
+ for (; size > 0; ++data, --size)
+  hash = rotateLeft(hash + *data * prime5, 11) * prime1;
+ hash ^= hash >> 15;
+ hash *= prime2;
+ hash ^= hash >> 13;
+ hash *= prime3;
+ hash ^= hash >> 16;
+ return hash;
+}
+
+void appendLz4Length(std::vector<unsigned char>& out, size_t length)
+{
+ for (; length >= 255; length -= 255)
+  out.push_back(255);
+ out.push_back(static_cast<unsigned char>(length));
+}
+
+// Appends an LZ4 sequence. A match length of 0 ends the block with literals only.
+void appendLz4Sequence(std::vector<unsigned char>& out, const unsigned char* literals, size_t literalLength, size_t offset, size_t matchLength)
+{
+ size_t matchCode = matchLength > 0 ? matchLength - 4 : 0;
+ out.push_back(static_cast<unsigned char>((std::min<size_t>(literalLength, 15) << 4) | std::min<size_t>(matchCode, 15)));
+ if (literalLength >= 15)
+  appendLz4Length(out, literalLength - 15);
+ out.insert(out.end(), literals, literals + literalLength);
+ if (matchLength == 0)
+  return;
+ out.push_back(static_cast<unsigned char>(offset));
+ out.push_back(static_cast<unsigned char>(offset >> 8));
+ if (matchCode >= 15)
+  appendLz4Length(out, matchCode - 15);
+}
+
+// Compresses a block in the LZ4 block format with a single probe hash table. The
+// table holds positions plus one, so zero marks an empty entry.
+void compressLz4Block(const unsigned char* data, size_t size, std::vector<unsigned char>& out, std::vector<uint32_t>& table)
+{
+ out.clear();
+ table.assign(1 << 16, 0);
+ size_t anchor = 0;
+
+ // The format needs the last match to start 12 bytes and end 5 bytes before the end.
+ if (size >= 13)
+ {
+  size_t matchStartLimit = size - 12;
+  size_t matchEndLimit = size - 5;
+  size_t position = 0;
+  while (position < matchStartLimit)
+  {
+   uint32_t sequence = readUInt32(data + position);
+   uint32_t hash = (sequence * 2654435761U) >> 16;
+   size_t candidate = table[hash];
+   table[hash] = static_cast<uint32_t>(position + 1);
+   if (candidate == 0 || position - (candidate - 1) > 65535 || readUInt32(data + candidate - 1) != sequence)
+   {
+    // Step faster through data that does not compress.
+    position += 1 + ((position - anchor) >> 6);
+    continue;
+   }
+
+   size_t reference = candidate - 1;
+   size_t length = 4;
+   while (position + length < matchEndLimit && data[reference + length] == data[position + length])
+    ++length;
+   while (position > anchor && reference > 0 && data[position - 1] == data[reference - 1])
+   {
+    --position;
+    --reference;
+    ++length;
+   }
+
+   appendLz4Sequence(out, data + anchor, position - anchor, position - reference, length);
+   position += length;
+   anchor = position;
+  }
+ }
+ appendLz4Sequence(out, data + anchor, size - anchor, 0, 0);
+}
+
+// A file written by the export, to be post-processed.
+struct PostExportJob
+{
+ size_t index = 0;
+ std::string sourcePath;
+ std::string format;
+};
+
+struct PostExportStats
+{
+ size_t storedCount = 0;
+ size_t duplicateCount = 0;
+ size_t failedCount = 0;
+ uint64_t sourceBytes = 0;
+ uint64_t storedBytes = 0;
+};
+
+// Post-processes exported files on worker threads. Each file is hashed with SHA-256,
+// compressed into an LZ4 frame and placed in a store under its hash, so identical
+// exports are kept once. Every file processed is appended to a journal. The workers
+// only touch files; all API calls stay on the main thread.
+class PostExportPipeline
+{
+public:
+ PostExportPipeline(const std::string& storePath, const std::string& journalPath, size_t threadCount)
+  : m_storePath(storePath), m_journal(journalPath.c_str(), std::ios::app)
+ {
+  for (size_t i = 0; i < threadCount; ++i)
+   m_threads.push_back(std::thread(&PostExportPipeline::work, this));
+ }
+
+ ~PostExportPipeline()
+ {
+  finish();
+ }
+
+ // Queues a file and returns at once.
+ void submit(const std::string& sourcePath, const std::string& format)
+ {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  PostExportJob job;
+  job.index = m_submittedCount++;
+  job.sourcePath = sourcePath;
+  job.format = format;
+  m_jobs.push(job);
+  m_jobAdded.notify_one();
+ }
+
+ size_t pendingCount()
+ {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  return m_submittedCount - m_finishedCount;
+ }
+
+ // Waits for the queued files and stops the workers.
+ void finish()
+ {
+  {
+   std::lock_guard<std::mutex> lock(m_mutex);
+   m_isStopping = true;
+   m_jobAdded.notify_all();
+  }
+  for (size_t i = 0; i < m_threads.size(); ++i)
+  {
+   if (m_threads[i].joinable())
+    m_threads[i].join();
+  }
+ }
+
+ PostExportStats stats()
+ {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  return m_stats;
+ }
+
+private:
+ void work()
+ {
+  std::vector<unsigned char> buffer;
+  std::vector<unsigned char> compressed;
+  std::vector<uint32_t> table;
+  for (;;)
+  {
+   PostExportJob job;
+   {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_jobAdded.wait(lock, [this] { return m_isStopping || !m_jobs.empty(); });
+    if (m_jobs.empty())
+     return;
+    job = m_jobs.front();
+    m_jobs.pop();
+   }
+   process(job, buffer, compressed, table);
+  }
+ }
+
+ void process(const PostExportJob& job, std::vector<unsigned char>& buffer, std::vector<unsigned char>& compressed, std::vector<uint32_t>& table)
+ {
+  std::chrono::steady_clock::time_point startTime = std::chrono::steady_clock::now();
+  const size_t blockSize = 4 << 20;
+  std::stringstream tempPath;
+  tempPath << m_storePath << "/" << job.index << ".tmp";
+
+  std::ifstream source(job.sourcePath.c_str(), std::ios::binary);
+  std::ofstream target(tempPath.str().c_str(), std::ios::binary | std::ios::trunc);
+  bool isOk = source && target;
+
+  // The frame has independent blocks of up to 4 MB and no content checksum, as the
+  // SHA-256 in the journal covers the content.
+  std::vector<unsigned char> header;
+  appendUInt32(header, 0x184D2204);
+  header.push_back(0x60);
+  header.push_back(0x70);
+  header.push_back(static_cast<unsigned char>(getShortXxHash32(&header[4], 2) >> 8));
+  target.write(reinterpret_cast<const char*>(header.data()), header.size());
+
+  Sha256 sha;
+  uint64_t sourceBytes = 0;
+  uint64_t storedBytes = header.size() + 4;
+  buffer.resize(blockSize);
+  while (isOk && source)
+  {
+   source.read(reinterpret_cast<char*>(buffer.data()), blockSize);
+   size_t size = static_cast<size_t>(source.gcount());
+   if (size == 0)
+    break;
+   sha.update(buffer.data(), size);
+   sourceBytes += size;
+
+   compressLz4Block(buffer.data(), size, compressed, table);
+   std::vector<unsigned char> blockHeader;
+   if (compressed.size() < size)
+   {
+    appendUInt32(blockHeader, static_cast<uint32_t>(compressed.size()));
+    target.write(reinterpret_cast<const char*>(blockHeader.data()), 4);
+    target.write(reinterpret_cast<const char*>(compressed.data()), compressed.size());
+    storedBytes += 4 + compressed.size();
+   }
+   else
+   {
+    appendUInt32(blockHeader, static_cast<uint32_t>(size) | 0x80000000U);
+    target.write(reinterpret_cast<const char*>(blockHeader.data()), 4);
+    target.write(reinterpret_cast<const char*>(buffer.data()), size);
+    storedBytes += 4 + size;
+   }
+  }
+  std::vector<unsigned char> endMark;
+  appendUInt32(endMark, 0);
+  target.write(reinterpret_cast<const char*>(endMark.data()), 4);
+  target.close();
+  isOk = isOk && source.eof() && target.good();
+
+  // Another worker may place the same content at the same time, so a failed rename onto
+  // an existing file is a duplicate too.
+  std::string digest = sha.finish();
+  std::string storedPath = m_storePath + "/" + digest + ".lz4";
+  bool isDuplicate = false;
+  if (isOk)
+  {
+   isDuplicate = std::ifstream(storedPath.c_str()).good();
+   if (!isDuplicate && std::rename(tempPath.str().c_str(), storedPath.c_str()) != 0)
+   {
+    isDuplicate = std::ifstream(storedPath.c_str()).good();
+    isOk = isDuplicate;
+   }
+  }
+  if (!isOk || isDuplicate)
+   std::remove(tempPath.str().c_str());
+  double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+
+  std::lock_guard<std::mutex> lock(m_mutex);
+  std::time_t now = std::time(nullptr);
+  char timeText[32] = "";
+  std::strftime(timeText, sizeof(timeText), "%Y-%m-%dT%H:%M:%SZ", std::gmtime(&now));
+  m_journal << timeText << "\t" << job.sourcePath << "\t" << job.format << "\t";
+  if (isOk)
+  {
+   m_journal << (isDuplicate ? "duplicate" : "stored") << "\t" << sourceBytes << "\t" << storedBytes << "\t" << digest << "\t" << storedPath;
+   if (isDuplicate)
+    ++m_stats.duplicateCount;
+   else
+    ++m_stats.storedCount;
+   m_stats.sourceBytes += sourceBytes;
+   m_stats.storedBytes += isDuplicate ? 0 : storedBytes;
+  }
+  else
+  {
+   m_journal << "failed\t\t\t\t";
+   ++m_stats.failedCount;
+  }
+  m_journal << "\t" << seconds << "\n";
+  m_journal.flush();
+  ++m_finishedCount;
+ }
+
+ std::string m_storePath;
+ std::ofstream m_journal;
+ std::vector<std::thread> m_threads;
+ std::mutex m_mutex;
+ std::condition_variable m_jobAdded;
+ std::queue<PostExportJob> m_jobs;
+ size_t m_submittedCount = 0;
+ size_t m_finishedCount = 0;
+ bool m_isStopping = false;
+ PostExportStats m_stats;
+};
+
 extern "C" XI_EXPORT bool run(const char* context)
 {
  Ptr<Application> app = Application::get();
@@ -57,35 +500,58 @@ extern "C" XI_EXPORT bool run(const char* context)
   return false;
 
 
+ Ptr<Component> rootComp = design->rootComponent();
+ if (!rootComp)
+  return false;
+
  Ptr<ExportManager> exportMgr = design->exportManager();
  if (!exportMgr)
   return false;
 
+ // hand each exported file to the post-export workers, which compress, hash and store it
+ // while the next export runs
  std::string pathName = getDllPath();
+ std::string storePath = pathName + "/" + "ExportStore";
+ if (!makeDirectory(storePath))
+  return false;
+ size_t threadCount = std::max(1U, std::min(4U, std::thread::hardware_concurrency() - 1));
+ PostExportPipeline pipeline(storePath, storePath + "/" + "journal.txt", threadCount);
+ std::chrono::steady_clock::time_point startTime = std::chrono::steady_clock::now();
+
  Ptr<IGESExportOptions> igesOptions = exportMgr->createIGESExportOptions(pathName + "/" + "test.igs");
  if (!igesOptions)
   return false;
- bRet = exportMgr->execute(igesOptions);
+ bool bRet = exportMgr->execute(igesOptions);
+ if (bRet)
+  pipeline.submit(pathName + "/" + "test.igs", "iges");
 
  Ptr<STEPExportOptions> stepOptions = exportMgr->createSTEPExportOptions(pathName + "/" + "test.step");
  if (!stepOptions)
   return false;
  bRet = exportMgr->execute(stepOptions);
+ if (bRet)
+  pipeline.submit(pathName + "/" + "test.step", "step");
 
  Ptr<SATExportOptions> satOptions = exportMgr->createSATExportOptions(pathName + "/" + "test.sat");
  if (!satOptions)
   return false;
  bRet = exportMgr->execute(satOptions);
+ if (bRet)
+  pipeline.submit(pathName + "/" + "test.sat", "sat");
 
  Ptr<SMTExportOptions> smtOptions = exportMgr->createSMTExportOptions(pathName + "/" + "test.smt");
  if (!smtOptions)
   return false;
  bRet = exportMgr->execute(smtOptions);
+ if (bRet)
+  pipeline.submit(pathName + "/" + "test.smt", "smt");
 
  Ptr<FusionArchiveExportOptions> fusionArchiveOptions = exportMgr->createFusionArchiveExportOptions(pathName + "/" + "test.f3d");
  if (!fusionArchiveOptions)
   return false;
  bRet = exportMgr->execute(fusionArchiveOptions);
+ if (bRet)
+  pipeline.submit(pathName + "/" + "test.f3d", "f3d");
 
  Ptr<STLExportOptions> stlOptions = exportMgr->createSTLExportOptions(rootComp, pathName + "/" + "test.stl");
  if (!stlOptions)
@@ -93,7 +559,25 @@ extern "C" XI_EXPORT bool run(const char* context)
  stlOptions->isBinaryFormat(true);
  stlOptions->meshRefinement(MeshRefinementHigh);
  bRet = exportMgr->execute(stlOptions);
+ if (bRet)
+  pipeline.submit(pathName + "/" + "test.stl", "stl");
+ double exportSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+
+ // keep Fusion responsive while the last files are processed
+ while (pipeline.pendingCount() > 0)
+ {
+  adsk::doEvents();
+  std::this_thread::sleep_for(std::chrono::milliseconds(10));
+ }
+ pipeline.finish();
+ double totalSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
 
+ PostExportStats stats = pipeline.stats();
+ std::stringstream message;
+ message << "Stored " << stats.storedCount << " files, " << stats.duplicateCount << " already in the store, " << stats.failedCount << " failed.\n"
+  << "Compressed " << stats.sourceBytes << " to " << stats.storedBytes << " bytes.\n"
+  << "Exports took " << exportSeconds << " s, post-processing finished " << totalSeconds - exportSeconds << " s after the last export.";
+ ui->messageBox(message.str());
 
  return true;
 }
@@ -1,6 +1,7 @@
 #include <Core/Application/Application.h>
 #include <Core/UserInterface/UserInterface.h>
 #include <Core/Application/Document.h>
+#include <Core/Geometry/Matrix3D.h>
 
 #include <Fusion/Fusion/Design.h>
 #include <Fusion/Fusion/ExportManager.h>
@@ -13,6 +14,12 @@
 #include <Fusion/BRep/BRepBodies.h>
 #include <Fusion/BRep/BRepBody.h>
 
+#include <chrono>
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
 
 using namespace adsk::core;
 using namespace adsk::fusion;
@@ -21,6 +28,136 @@ Ptr<UserInterface> ui;
 
 std::string getDllPath();
 
+// Occurrences of one revision of a component, written to one shared STL file.
+struct StlExportGroup
+{
+ std::string fileName;
+ std::vector< Ptr<Occurrence> > occurrences;
+};
+
+struct StlExportReport
+{
+ size_t occurrenceCount = 0;
+ size_t fileCount = 0;
+ double seconds = 0.0;
+ double estimatedSecondsSaved = 0.0;
+ unsigned long long bytesWritten = 0;
+ unsigned long long bytesSaved = 0;
+};
+
+// Gets the transform of the occurrence in the context of the root component.
+Ptr<Matrix3D> getWorldTransform(const Ptr<Occurrence>& occ)
+{
+ Ptr<Matrix3D> transform = occ->transform();
+ if (!transform)
+  return nullptr;
+ transform = transform->copy();
+ for (Ptr<Occurrence> parent = occ->assemblyContext(); parent; parent = parent->assemblyContext())
+ {
+  Ptr<Matrix3D> parentTransform = parent->transform();
+  if (!parentTransform || !transform->transformBy(parentTransform))
+   return nullptr;
+ }
+ return transform;
+}
+
+// Groups the occurrences that have bodies by component and revision, in the order of
+// their first occurrence. Each group gets a file name made unique by its index.
+bool planStlExport(const Ptr<OccurrenceList>& occs, const std::string& directory, std::vector<StlExportGroup>& groups)
+{
+ groups.clear();
+ if (!occs)
+  return false;
+
+ std::map<std::string, size_t> groupOfComponent;
+ for (size_t i = 0; i < occs->count(); ++i)
+ {
+  Ptr<Occurrence> occ = occs->item(i);
+  if (!occ)
+   continue;
+  Ptr<Component> comp = occ->component();
+  if (!comp)
+   continue;
+  Ptr<BRepBodies> bodies = comp->bRepBodies();
+  if (!bodies || bodies->count() == 0)
+   continue;
+
+  std::string key = comp->id() + "|" + comp->revisionId();
+  std::map<std::string, size_t>::const_iterator found = groupOfComponent.find(key);
+  if (found == groupOfComponent.end())
+  {
+   std::string compName = comp->name();
+   for (size_t j = 0; j < compName.size(); ++j)
+   {
+    char c = compName[j];
+    if (!((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '-' || c == '_'))
+     compName[j] = '_';
+   }
+
+   found = groupOfComponent.insert(std::make_pair(key, groups.size())).first;
+   groups.push_back(StlExportGroup());
+   std::stringstream fileName;
+   fileName << directory << "/" << compName << "_" << groups.size() << ".stl";
+   groups.back().fileName = fileName.str();
+  }
+  groups[found->second].occurrences.push_back(occ);
+ }
+ return true;
+}
+
+// Exports the first occurrence of each group and writes a tab separated manifest with,
+// for each occurrence, its path, its file and the 3x4 transform that places the
+// geometry of the file on the occurrence.
+bool exportStlGroups(const Ptr<ExportManager>& exportMgr, const std::vector<StlExportGroup>& groups, const std::string& manifestPath, StlExportReport& report)
+{
+ report = StlExportReport();
+ std::ofstream manifest(manifestPath.c_str(), std::ios::trunc);
+ if (!exportMgr || !manifest)
+  return false;
+ manifest << "occurrence\tfile\ttransform\n";
+
+ std::chrono::steady_clock::time_point startTime = std::chrono::steady_clock::now();
+ for (size_t i = 0; i < groups.size(); ++i)
+ {
+  const StlExportGroup& group = groups[i];
+  Ptr<Occurrence> referenceOcc = group.occurrences.front();
+  Ptr<STLExportOptions> stlExportOptions = exportMgr->createSTLExportOptions(referenceOcc, group.fileName);
+  if (!stlExportOptions)
+   return false;
+  stlExportOptions->sendToPrintUtility(false);
+  if (!exportMgr->execute(stlExportOptions))
+   return false;
+
+  std::ifstream exportedFile(group.fileName.c_str(), std::ios::binary | std::ios::ate);
+  unsigned long long fileSize = exportedFile ? static_cast<unsigned long long>(exportedFile.tellg()) : 0;
+  report.bytesWritten += fileSize;
+  report.bytesSaved += fileSize * (group.occurrences.size() - 1);
+  ++report.fileCount;
+
+  Ptr<Matrix3D> referenceInverse = getWorldTransform(referenceOcc);
+  if (!referenceInverse || !referenceInverse->invert())
+   return false;
+  for (size_t j = 0; j < group.occurrences.size(); ++j)
+  {
+   Ptr<Matrix3D> placement = referenceInverse->copy();
+   Ptr<Matrix3D> worldTransform = getWorldTransform(group.occurrences[j]);
+   if (!placement || !worldTransform || !placement->transformBy(worldTransform))
+    return false;
+
+   std::vector<double> values = placement->asArray();
+   manifest << group.occurrences[j]->fullPathName() << "\t" << group.fileName;
+   for (size_t k = 0; k < 12 && k < values.size(); ++k)
+    manifest << "\t" << values[k];
+   manifest << "\n";
+   ++report.occurrenceCount;
+  }
+ }
+ report.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+ if (report.fileCount > 0)
+  report.estimatedSecondsSaved = report.seconds / report.fileCount * (report.occurrenceCount - report.fileCount);
+ return manifest.good();
+}
+
 extern "C" XI_EXPORT bool run(const char* context)
 {
  Ptr<Application> app = Application::get();
@@ -69,28 +206,18 @@ extern "C" XI_EXPORT bool run(const char* context)
   exportMgr->execute(stlRootOptions);
  }
 
- // export the occurrence one by one in the root component to a specified file
- Ptr<OccurrenceList> occurs = rootComp->allOccurrences();
- if (!occurs)
+ // export each component once, shared by all its occurrences, with a manifest of the occurrences
+ std::vector<StlExportGroup> exportGroups;
+ if (!planStlExport(rootComp->allOccurrences(), getDllPath(), exportGroups))
+  return false;
+ StlExportReport exportReport;
+ if (!exportStlGroups(exportMgr, exportGroups, getDllPath() + "/" + "StlExport.manifest", exportReport))
   return false;
- size_t occrCount = occurs->count();
- for (size_t j = 0; j < occrCount; j++ )
- {
-  Ptr<Occurrence> occur = occurs->item(j);
-  if (!occur) continue;
-
-  Ptr<Component> comp = occur->component();
-  if (!comp) continue;
-
-  std::string compName = comp->name();
-  std::string fileName = getDllPath() + "/" + compName;
-
-  // create stl exportOptions
-  Ptr<STLExportOptions> stlExportOptions = exportMgr->createSTLExportOptions(occur, fileName);
-  stlExportOptions->sendToPrintUtility(false);
 
-  exportMgr->execute(stlExportOptions);
- }
+ std::stringstream exportMessage;
+ exportMessage << "Exported " << exportReport.fileCount << " files for " << exportReport.occurrenceCount << " occurrences in " << exportReport.seconds << " s.\n"
+  << "Estimated time saved: " << exportReport.estimatedSecondsSaved << " s, disk saved: " << exportReport.bytesSaved / 1024 << " KB";
+ ui->messageBox(exportMessage.str());
 
  // export the body one by one in the design to a specified file
  Ptr<BRepBodies> bRepBodies = rootComp->bRepBodies();
@@ -1,47 +1,680 @@
 #include <Core/Application/Application.h>
 #include <Core/UserInterface/UserInterface.h>
+#include <Fusion/Fusion/Design.h>
 #include <Fusion/Fusion/UserParameters.h>
 #include <Fusion/Fusion/UserParameter.h>
 #include <Fusion/Fusion/STEPExportOptions.h>
 #include <Fusion/Fusion/ExportManager.h>
 
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
 #include <fstream>
+#include <iomanip>
 #include <iostream>
+#include <map>
+#include <set>
 #include <sstream>
 #include <string>
 #include <vector>
 
+#ifdef XI_WIN
+// Keep windows.h from defining min and max macros, which break std::min and std::max
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
 
 using namespace adsk::core;
 using namespace adsk::fusion;
 
 Ptr<UserInterface> ui;
 
-typedef std::vector<std::vector<std::string>> DataSet;
+// Read-only view of a whole file mapped in memory.
+class MappedFile
+{
+public:
+ ~MappedFile()
+ {
+  close();
+ }
 
-void loadCSVFile(const std::string& csvFilePath, DataSet& dataSet)
+ bool open(const std::string& filePath)
+ {
+  close();
+#ifdef XI_WIN
+  m_file = CreateFileA(filePath.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+  if (m_file == INVALID_HANDLE_VALUE)
+   return false;
+  LARGE_INTEGER fileSize;
+  if (!GetFileSizeEx(m_file, &fileSize) || fileSize.QuadPart == 0)
+  {
+   close();
+   return false;
+  }
+  m_size = static_cast<size_t>(fileSize.QuadPart);
+  m_mapping = CreateFileMappingA(m_file, NULL, PAGE_READONLY, 0, 0, NULL);
+  if (!m_mapping)
+  {
+   close();
+   return false;
+  }
+  m_data = static_cast<const char*>(MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0));
+#else
+  m_file = ::open(filePath.c_str(), O_RDONLY);
+  if (m_file < 0)
+   return false;
+  struct stat fileStat;
+  if (fstat(m_file, &fileStat) != 0 || fileStat.st_size == 0)
+  {
+   close();
+   return false;
+  }
+  m_size = static_cast<size_t>(fileStat.st_size);
+  void* data = mmap(NULL, m_size, PROT_READ, MAP_PRIVATE, m_file, 0);
+  m_data = data != MAP_FAILED ? static_cast<const char*>(data) : nullptr;
+#endif
+  if (!m_data)
+  {
+   close();
+   return false;
+  }
+  return true;
+ }
+
+ void close()
+ {
+#ifdef XI_WIN
+  if (m_data)
+   UnmapViewOfFile(m_data);
+  if (m_mapping)
+   CloseHandle(m_mapping);
+  if (m_file != INVALID_HANDLE_VALUE)
+   CloseHandle(m_file);
+  m_mapping = NULL;
+  m_file = INVALID_HANDLE_VALUE;
+#else
+  if (m_data)
+   munmap(const_cast<char*>(m_data), m_size);
+  if (m_file >= 0)
+   ::close(m_file);
+  m_file = -1;
+#endif
+  m_data = nullptr;
+  m_size = 0;
+ }
+
+ const char* data() const { return m_data; }
+ size_t size() const { return m_size; }
+
+private:
+#ifdef XI_WIN
+ HANDLE m_file = INVALID_HANDLE_VALUE;
+ HANDLE m_mapping = NULL;
+#else
+ int m_file = -1;
+#endif
+ const char* m_data = nullptr;
+ size_t m_size = 0;
+};
+
+// A field of a CSV file, as a view over the mapped file. A quoted field excludes its
+// quotes, and isEscaped marks one with doubled quotes inside.
+struct CsvField
+{
+ const char* data = nullptr;
+ uint32_t size = 0;
+ bool isEscaped = false;
+};
+
+// Parses the field at position and moves past its delimiter. Returns false when the
+// field ends the row.
+bool parseCsvField(const char*& position, const char* end, CsvField& field)
 {
- std::ifstream infile( csvFilePath );
+ field = CsvField();
+ if (position < end && *position == '"')
+ {
+  const char* start = ++position;
+  const char* closingQuote = end;
+  while (position < end)
+  {
+   const char* quote = static_cast<const char*>(memchr(position, '"', end - position));
+   if (!quote)
+    break;
+   if (quote + 1 < end && quote[1] == '"')
+   {
+    field.isEscaped = true;
+    position = quote + 2;
+    continue;
+   }
+   closingQuote = quote;
+   break;
+  }
+  field.data = start;
+  field.size = static_cast<uint32_t>(closingQuote - start);
+  position = closingQuote < end ? closingQuote + 1 : end;
+ }
+ else
+ {
+  const char* start = position;
+  while (position < end && *position != ',' && *position != '\n')
+   ++position;
+  field.data = start;
+  field.size = static_cast<uint32_t>(position - start);
+  if (field.size > 0 && start[field.size - 1] == '\r')
+   --field.size;
+ }
+
+ // Anything between a closing quote and the delimiter, such as a carriage return, is dropped.
+ while (position < end && *position != ',' && *position != '\n')
+  ++position;
+ if (position == end)
+  return false;
+ return *position++ == ',';
+}
 
- while (infile)
+// Table of a CSV file, stored by column as views over the mapped file. The first row
+// is a header naming the parameter each column sets when all of its fields are names
+// of parameters. Otherwise it is a row of values, such as "10 mm,20 mm,5 mm", and the
+// columns take the default names.
+class CsvTable
+{
+public:
+ bool load(const std::string& filePath, const std::set<std::string>& parameterNames, const std::vector<std::string>& defaultColumnNames)
  {
-  std::string s;
-  if (!getline( infile, s )) break;
+  m_columnNames.clear();
+  m_columns.clear();
+  m_rowCount = 0;
+  m_malformedRowCount = 0;
+  if (!m_file.open(filePath))
+   return false;
+
+  const char* position = m_file.data();
+  const char* end = position + m_file.size();
+  if (end - position >= 3 && memcmp(position, "\xEF\xBB\xBF", 3) == 0)
+   position += 3;
 
-  std::istringstream ss( s );
-  std::vector<std::string> record;
+  // Count the lines first, so the columns are allocated once.
+  size_t lineCount = 1;
+  for (const char* line = position; (line = static_cast<const char*>(memchr(line, '\n', end - line))) != nullptr; ++line)
+   ++lineCount;
 
-  while (ss)
+  std::vector<CsvField> fields;
+  if (!parseCsvRow(position, end, fields))
+   return false;
+  bool hasHeader = true;
+  for (size_t i = 0; i < fields.size() && hasHeader; ++i)
+   hasHeader = parameterNames.count(getText(fields[i])) > 0;
+  if (hasHeader)
+  {
+   for (size_t i = 0; i < fields.size(); ++i)
+    m_columnNames.push_back(getText(fields[i]));
+  }
+  else
   {
-   std::string s;
-   if (!getline( ss, s, ',' )) break;
-   record.push_back( s );
+   if (fields.size() > defaultColumnNames.size())
+    return false;
+   m_columnNames.assign(defaultColumnNames.begin(), defaultColumnNames.begin() + fields.size());
   }
 
-  dataSet.push_back( record );
+  m_columns.resize(m_columnNames.size());
+  for (size_t i = 0; i < m_columns.size(); ++i)
+   m_columns[i].reserve(lineCount);
+  if (!hasHeader)
+   addRow(fields);
+  while (parseCsvRow(position, end, fields))
+   addRow(fields);
+  return true;
  }
+
+ const std::vector<std::string>& columnNames() const { return m_columnNames; }
+ size_t columnCount() const { return m_columns.size(); }
+ size_t rowCount() const { return m_rowCount; }
+
+ // Rows with fewer fields than the header; their missing fields are empty.
+ size_t malformedRowCount() const { return m_malformedRowCount; }
+
+ const CsvField& field(size_t row, size_t column) const { return m_columns[column][row]; }
+ std::string text(size_t row, size_t column) const { return getText(m_columns[column][row]); }
+
+ static std::string getText(const CsvField& field)
+ {
+  std::string text(field.data, field.size);
+  if (field.isEscaped)
+  {
+   size_t count = 0;
+   for (size_t i = 0; i < text.size(); ++i, ++count)
+   {
+    text[count] = text[i];
+    if (text[i] == '"' && i + 1 < text.size() && text[i + 1] == '"')
+     ++i;
+   }
+   text.resize(count);
+  }
+  return text;
+ }
+
+private:
+ // Parses the next row that is not blank. Returns false at the end of the file.
+ static bool parseCsvRow(const char*& position, const char* end, std::vector<CsvField>& fields)
+ {
+  while (position < end)
+  {
+   fields.clear();
+   bool isBlank = *position == '\n' || *position == '\r';
+   CsvField field;
+   bool hasMore = true;
+   while (hasMore)
+   {
+    hasMore = parseCsvField(position, end, field);
+    fields.push_back(field);
+   }
+   if (!isBlank || fields.size() > 1)
+    return true;
+  }
+  return false;
+ }
+
+ void addRow(const std::vector<CsvField>& fields)
+ {
+  if (fields.size() < m_columns.size())
+   ++m_malformedRowCount;
+  for (size_t i = 0; i < m_columns.size(); ++i)
+   m_columns[i].push_back(i < fields.size() ? fields[i] : CsvField());
+  ++m_rowCount;
+ }
+
+ MappedFile m_file;
+ std::vector<std::string> m_columnNames;
+ std::vector<std::vector<CsvField>> m_columns;
+ size_t m_rowCount = 0;
+ size_t m_malformedRowCount = 0;
+};
+
+// Sorts rows[begin, end) by the column keys from level on, reversing the direction of
+// each key at every new group of the key before it, as a reflected Gray code does. The
+// groups are counted per level over the whole sort, not per parent group, so that the
+// direction carries over from the last group of one parent to the first of the next.
+// On a full grid of values, consecutive rows then differ in one column.
+void sortRowsAsGrayCode(std::vector<size_t>& rows, size_t begin, size_t end, const std::vector<const std::vector<uint32_t>*>& keys, size_t level, bool isDescending, std::vector<size_t>& groupCounts)
+{
+ if (level == keys.size())
+  return;
+ const std::vector<uint32_t>& key = *keys[level];
+ std::stable_sort(rows.begin() + begin, rows.begin() + end, [&key, isDescending](size_t a, size_t b)
+ {
+  return isDescending ? key[a] > key[b] : key[a] < key[b];
+ });
+
+ for (size_t groupBegin = begin; groupBegin < end;)
+ {
+  size_t groupEnd = groupBegin + 1;
+  while (groupEnd < end && key[rows[groupEnd]] == key[rows[groupBegin]])
+   ++groupEnd;
+  sortRowsAsGrayCode(rows, groupBegin, groupEnd, keys, level + 1, groupCounts[level]++ % 2 == 1, groupCounts);
+  groupBegin = groupEnd;
+ }
+}
+
+// Gets the 64 bit FNV-1a hash of the bytes.
+uint64_t hashBytes(const char* data, size_t size, uint64_t hash = 14695981039346656037ULL)
+{
+ for (size_t i = 0; i < size; ++i)
+ {
+  hash ^= static_cast<unsigned char>(data[i]);
+  hash *= 1099511628211ULL;
+ }
+ return hash;
 }
 
+enum VariantStatus
+{
+ VariantExported = 'e',
+ VariantFailed = 'f',
+ VariantOverBudget = 'b',
+ VariantCrashed = 'c'
+};
+
+// Outcome of one variant of a sweep. A status of 0 means the variant has not run.
+struct VariantRecord
+{
+ char status = 0;
+ double computeSeconds = 0;
+ double exportSeconds = 0;
+ std::vector<size_t> changedColumns;
+};
+
+// Append-only journal of the variants of a sweep. A variant writes a start line before it
+// computes and a done line after, flushing each, so a variant that took Fusion down is
+// found on the next run by its start line without a done line. The rows are checked
+// against a hash of their values, so records of a table that has since changed are dropped.
+class VariantJournal
+{
+public:
+ // Reads the journal of earlier runs into records, and marks the rows that started
+ // without finishing.
+ void load(const std::string& filePath, const std::vector<uint64_t>& rowHashes, std::vector<VariantRecord>& records, std::vector<bool>& isStarted)
+ {
+  records.assign(rowHashes.size(), VariantRecord());
+  isStarted.assign(rowHashes.size(), false);
+  std::ifstream file(filePath.c_str());
+  std::string line;
+  while (file && std::getline(file, line))
+  {
+   std::vector<std::string> fields;
+   std::stringstream lineStream(line);
+   std::string field;
+   while (std::getline(lineStream, field, '\t'))
+    fields.push_back(field);
+   if (fields.size() < 3)
+    continue;
+   size_t row = static_cast<size_t>(strtoull(fields[1].c_str(), nullptr, 10));
+   if (row >= rowHashes.size() || strtoull(fields[2].c_str(), nullptr, 16) != rowHashes[row])
+    continue;
+
+   if (fields[0] == "start")
+   {
+    isStarted[row] = true;
+   }
+   else if (fields[0] == "done" && fields.size() >= 6 && fields[3].size() == 1)
+   {
+    VariantRecord& record = records[row];
+    record.status = fields[3][0];
+    record.computeSeconds = strtod(fields[4].c_str(), nullptr);
+    record.exportSeconds = strtod(fields[5].c_str(), nullptr);
+    record.changedColumns.clear();
+    std::stringstream columns(fields.size() > 6 ? fields[6] : "");
+    size_t column;
+    while (columns >> column)
+     record.changedColumns.push_back(column);
+   }
+  }
+ }
+
+ bool open(const std::string& filePath)
+ {
+  m_file.open(filePath.c_str(), std::ios::app);
+  return m_file.good();
+ }
+
+ void start(size_t row, uint64_t rowHash)
+ {
+  m_file << "start\t" << row << "\t" << std::hex << rowHash << std::dec << "\n";
+  m_file.flush();
+ }
+
+ void finish(size_t row, uint64_t rowHash, const VariantRecord& record)
+ {
+  m_file << "done\t" << row << "\t" << std::hex << rowHash << std::dec << "\t" << record.status << "\t" << record.computeSeconds << "\t" << record.exportSeconds << "\t";
+  for (size_t i = 0; i < record.changedColumns.size(); ++i)
+   m_file << (i > 0 ? " " : "") << record.changedColumns[i];
+  m_file << "\n";
+  m_file.flush();
+ }
+
+private:
+ std::ofstream m_file;
+};
+
+struct ParameterSweepStats
+{
+ size_t exportedCount = 0;
+ size_t duplicateCount = 0;
+ size_t failedCount = 0;
+ size_t overBudgetCount = 0;
+ size_t crashedCount = 0;
+ size_t resumedCount = 0;
+ size_t setCount = 0;
+ size_t unchangedCount = 0;
+};
+
+// Runs the rows of a table as design variants, exporting a STEP file for each. The
+// parameter and export manager handles are resolved once. The rows run in an order that
+// changes few parameters between variants, an expression equal to the current one is not
+// set again, and a row repeating the values of an earlier one is not exported again.
+// Variants are journaled, so a stopped sweep resumes where it was, and one that fails or
+// computes for longer than the budget is recorded and skipped rather than ending the sweep.
+class ParameterSweep
+{
+public:
+ bool init(const Ptr<Design>& design, const CsvTable& table)
+ {
+  m_table = &table;
+  m_params.clear();
+  m_expressions.clear();
+  m_exportMgr = design->exportManager();
+  if (!m_exportMgr)
+   return false;
+  Ptr<UserParameters> userParams = design->userParameters();
+  if (!userParams)
+   return false;
+  for (size_t column = 0; column < table.columnCount(); ++column)
+  {
+   Ptr<UserParameter> param = userParams->itemByName(table.columnNames()[column]);
+   if (!param)
+   {
+    ui->messageBox("The parameter \"" + table.columnNames()[column] + "\" must exist.");
+    return false;
+   }
+   m_params.push_back(param);
+   m_expressions.push_back(param->expression());
+  }
+  planOrder();
+  return true;
+ }
+
+ // Sets the parameters of each row in turn and exports the design to
+ // filePrefix + row + ".stp", named by the row in the file whatever order it runs in.
+ // Rows the journal at journalPath finished are skipped, and a variant whose compute
+ // takes longer than computeBudgetSeconds is not exported.
+ ParameterSweepStats run(const std::string& filePrefix, const std::string& journalPath, double computeBudgetSeconds)
+ {
+  ParameterSweepStats stats;
+  VariantJournal journal;
+  std::vector<bool> isStarted;
+  journal.load(journalPath, m_rowHashes, m_records, isStarted);
+  if (!journal.open(journalPath))
+   return stats;
+
+  for (size_t i = 0; i < m_order.size(); ++i)
+  {
+   size_t row = m_order[i];
+   if (m_isDuplicate[row])
+   {
+    ++stats.duplicateCount;
+    continue;
+   }
+   VariantRecord& record = m_records[row];
+   if (record.status != 0)
+   {
+    ++stats.resumedCount;
+    continue;
+   }
+   if (isStarted[row])
+   {
+    // An earlier run stopped inside this variant, so do not try it again.
+    record.status = VariantCrashed;
+    journal.finish(row, m_rowHashes[row], record);
+    ++stats.crashedCount;
+    continue;
+   }
+
+   journal.start(row, m_rowHashes[row]);
+   std::chrono::steady_clock::time_point startTime = std::chrono::steady_clock::now();
+   bool isComputed = true;
+   for (size_t column = 0; column < m_params.size(); ++column)
+   {
+    std::string expression = m_table->text(row, column);
+    if (expression == m_expressions[column])
+    {
+     ++stats.unchangedCount;
+     continue;
+    }
+    record.changedColumns.push_back(column);
+    ++stats.setCount;
+    if (m_params[column]->expression(expression))
+     m_expressions[column] = expression;
+    else
+     isComputed = false;
+   }
+   std::chrono::steady_clock::time_point computedTime = std::chrono::steady_clock::now();
+   record.computeSeconds = std::chrono::duration<double>(computedTime - startTime).count();
+
+   if (!isComputed)
+   {
+    record.status = VariantFailed;
+    ++stats.failedCount;
+   }
+   else if (record.computeSeconds > computeBudgetSeconds)
+   {
+    record.status = VariantOverBudget;
+    ++stats.overBudgetCount;
+   }
+   else
+   {
+    Ptr<STEPExportOptions> stepOptions = m_exportMgr->createSTEPExportOptions(filePrefix + std::to_string(row) + ".stp");
+    bool isExported = stepOptions && m_exportMgr->execute(stepOptions);
+    record.exportSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - computedTime).count();
+    record.status = isExported ? VariantExported : VariantFailed;
+    if (isExported)
+     ++stats.exportedCount;
+    else
+     ++stats.failedCount;
+   }
+   journal.finish(row, m_rowHashes[row], record);
+  }
+  return stats;
+ }
+
+ // Gets a table of the variants that took longest to compute, and the average compute
+ // time of the variants that changed each parameter, over this run and earlier ones.
+ std::string getSummary(size_t slowestCount) const
+ {
+  std::vector<size_t> rows;
+  std::vector<size_t> changeCounts(m_params.size(), 0);
+  std::vector<double> changeSeconds(m_params.size(), 0);
+  for (size_t row = 0; row < m_records.size(); ++row)
+  {
+   const VariantRecord& record = m_records[row];
+   if (record.status == 0 || record.status == VariantCrashed)
+    continue;
+   rows.push_back(row);
+   for (size_t i = 0; i < record.changedColumns.size(); ++i)
+   {
+    if (record.changedColumns[i] >= m_params.size())
+     continue;
+    ++changeCounts[record.changedColumns[i]];
+    changeSeconds[record.changedColumns[i]] += record.computeSeconds;
+   }
+  }
+  slowestCount = std::min(slowestCount, rows.size());
+  std::partial_sort(rows.begin(), rows.begin() + slowestCount, rows.end(), [this](size_t a, size_t b)
+  {
+   return m_records[a].computeSeconds > m_records[b].computeSeconds;
+  });
+
+  std::stringstream summary;
+  summary << std::fixed << std::setprecision(2) << "Slowest variants (row, compute s, export s, status, values, changed):\n";
+  for (size_t i = 0; i < slowestCount; ++i)
+  {
+   const VariantRecord& record = m_records[rows[i]];
+   summary << rows[i] << "\t" << record.computeSeconds << "\t" << record.exportSeconds << "\t" << record.status << "\t";
+   for (size_t column = 0; column < m_params.size(); ++column)
+    summary << (column > 0 ? ", " : "") << m_table->columnNames()[column] << "=" << m_table->text(rows[i], column);
+   summary << "\t";
+   for (size_t j = 0; j < record.changedColumns.size(); ++j)
+   {
+    if (record.changedColumns[j] < m_params.size())
+     summary << (j > 0 ? ", " : "") << m_table->columnNames()[record.changedColumns[j]];
+   }
+   summary << "\n";
+  }
+  summary << "Average compute by changed parameter:\n";
+  for (size_t column = 0; column < m_params.size(); ++column)
+  {
+   if (changeCounts[column] > 0)
+    summary << m_table->columnNames()[column] << "\t" << changeCounts[column] << " variants\t" << changeSeconds[column] / changeCounts[column] << " s\n";
+  }
+  return summary.str();
+ }
+
+private:
+ // Numbers each distinct value of each column, by numeric value and then text, orders
+ // the rows with the column of fewest distinct values outermost, and marks rows equal to
+ // the row before them, which the sorting places next to each other.
+ void planOrder()
+ {
+  size_t rowCount = m_table->rowCount();
+  std::vector<std::vector<uint32_t>> ordinals(m_params.size());
+  std::vector<size_t> distinctCounts(m_params.size());
+  for (size_t column = 0; column < m_params.size(); ++column)
+  {
+   std::vector<std::pair<double, std::string>> values(rowCount);
+   for (size_t row = 0; row < rowCount; ++row)
+   {
+    values[row].second = m_table->text(row, column);
+    values[row].first = strtod(values[row].second.c_str(), nullptr);
+   }
+   std::vector<std::pair<double, std::string>> distinctValues = values;
+   std::sort(distinctValues.begin(), distinctValues.end());
+   distinctValues.erase(std::unique(distinctValues.begin(), distinctValues.end()), distinctValues.end());
+   distinctCounts[column] = distinctValues.size();
+
+   ordinals[column].resize(rowCount);
+   for (size_t row = 0; row < rowCount; ++row)
+    ordinals[column][row] = static_cast<uint32_t>(std::lower_bound(distinctValues.begin(), distinctValues.end(), values[row]) - distinctValues.begin());
+  }
+
+  std::vector<size_t> columns(m_params.size());
+  for (size_t column = 0; column < columns.size(); ++column)
+   columns[column] = column;
+  std::stable_sort(columns.begin(), columns.end(), [&distinctCounts](size_t a, size_t b) { return distinctCounts[a] < distinctCounts[b]; });
+  std::vector<const std::vector<uint32_t>*> keys;
+  for (size_t i = 0; i < columns.size(); ++i)
+   keys.push_back(&ordinals[columns[i]]);
+
+  m_order.resize(rowCount);
+  for (size_t row = 0; row < rowCount; ++row)
+   m_order[row] = row;
+  std::vector<size_t> groupCounts(keys.size(), 0);
+  sortRowsAsGrayCode(m_order, 0, rowCount, keys, 0, false, groupCounts);
+
+  m_rowHashes.assign(rowCount, 14695981039346656037ULL);
+  for (size_t row = 0; row < rowCount; ++row)
+  {
+   for (size_t column = 0; column < m_params.size(); ++column)
+   {
+    std::string text = m_table->text(row, column) + "\x1f";
+    m_rowHashes[row] = hashBytes(text.data(), text.size(), m_rowHashes[row]);
+   }
+  }
+
+  m_isDuplicate.assign(rowCount, false);
+  for (size_t i = 1; i < rowCount; ++i)
+  {
+   bool isSame = true;
+   for (size_t column = 0; column < ordinals.size() && isSame; ++column)
+    isSame = ordinals[column][m_order[i]] == ordinals[column][m_order[i - 1]];
+   m_isDuplicate[m_order[i]] = isSame;
+  }
+ }
+
+ const CsvTable* m_table = nullptr;
+ Ptr<ExportManager> m_exportMgr;
+ std::vector<Ptr<UserParameter>> m_params;
+ std::vector<std::string> m_expressions;
+ std::vector<size_t> m_order;
+ std::vector<bool> m_isDuplicate;
+ std::vector<uint64_t> m_rowHashes;
+ std::vector<VariantRecord> m_records;
+};
+
 std::string getTempPath()
 {
  std::string strTempPath;
@@ -69,51 +702,66 @@ extern "C" XI_EXPORT bool run(const char* context)
   return false;
 
 
- // Read the csv file.
- int cnt = 0;
-
- DataSet dataSet;
- loadCSVFile("C:\\Temp\\values.csv", dataSet);
+ Ptr<Product> product = app->activeProduct();
+ if (!product)
+  return false;
 
- for (auto data : dataSet)
- {
-  // Get the values from the csv file.
-  std::string length = data.at(0);
-  std::string width = data.at(1);
-  std::string height = data.at(2);
+ Ptr<Design> design = product;
+ if (!design)
+  return false;
 
-  // Set the parameters.
-  Ptr<UserParameters> userParams = design->userParameters();
-  if (!userParams)
-   return false;
-  Ptr<UserParameter> lengthParam = userParams->itemByName("Length");
-  if (!lengthParam)
-   return false;
-  lengthParam->expression(length);
+ // Read the csv file. The header names the user parameters; a file without one sets
+ // the Length, Width and Height.
+ std::string csvFilePath = "C:\\Temp\\values.csv";
+ std::vector<std::string> defaultColumnNames;
+ defaultColumnNames.push_back("Length");
+ defaultColumnNames.push_back("Width");
+ defaultColumnNames.push_back("Height");
 
-  Ptr<UserParameter> widthParam = userParams->itemByName("Width");
-  if (!widthParam)
-   return false;
-  widthParam->expression(width);
+ Ptr<UserParameters> userParams = design->userParameters();
+ if (!userParams)
+  return false;
+ std::set<std::string> parameterNames;
+ for (size_t i = 0; i < userParams->count(); ++i)
+ {
+  Ptr<UserParameter> param = userParams->item(i);
+  if (param)
+   parameterNames.insert(param->name());
+ }
 
-  Ptr<UserParameter> heightParam = userParams->itemByName("Height");
-  if (!heightParam)
-   return false;
-  heightParam->expression(height);
+ CsvTable table;
+ std::chrono::steady_clock::time_point loadStartTime = std::chrono::steady_clock::now();
+ if (!table.load(csvFilePath, parameterNames, defaultColumnNames))
+ {
+  ui->messageBox("Unable to read \"" + csvFilePath + "\".");
+  return false;
+ }
+ double loadSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - loadStartTime).count();
 
-  // Export the STEP file.
-  Ptr<ExportManager> exportMgr = design->exportManager();
-  if (!exportMgr)
-   return false;
-  std::string filename = "C:\\Temp\\test_box" + std::to_string(cnt) + ".stp";
-  Ptr<STEPExportOptions> stepOptions = exportMgr->createSTEPExportOptions(filename);
-  if (!stepOptions)
-   return false;
+ // Run the rows as variants, exporting each to a STEP file. The journal lets a stopped
+ // sweep resume; delete it to run every variant again.
+ std::string filePrefix = "C:\\Temp\\test_box";
+ const double computeBudgetSeconds = 120;
+ ParameterSweep sweep;
+ if (!sweep.init(design, table))
+  return false;
+ ParameterSweepStats stats = sweep.run(filePrefix, filePrefix + ".journal", computeBudgetSeconds);
 
-  ++cnt;
-  exportMgr->execute(stepOptions);
- }
+ // Keep the summary next to the exports, as the message box shows only part of a long sweep.
+ std::string summary = sweep.getSummary(10);
+ std::ofstream summaryFile(filePrefix + ".summary.txt");
+ summaryFile << summary;
 
+ std::stringstream message;
+ message << "Read " << table.rowCount() << " rows of " << table.columnCount() << " parameters in " << loadSeconds << " s ("
+  << (loadSeconds > 0 ? table.rowCount() / loadSeconds : 0) << " rows/s)";
+ if (table.malformedRowCount() > 0)
+  message << ", " << table.malformedRowCount() << " of them short of fields";
+ message << ".\nExported " << stats.exportedCount << " STEP files, failed " << stats.failedCount << ", skipped " << stats.duplicateCount
+  << " repeated rows, " << stats.overBudgetCount << " over the " << computeBudgetSeconds << " s compute budget and " << stats.crashedCount
+  << " that stopped an earlier run. " << stats.resumedCount << " variants were done by earlier runs.\nSet " << stats.setCount
+  << " expressions, left " << stats.unchangedCount << " unchanged.\n\n" << summary;
+ ui->messageBox(message.str());
 
  return true;
 }
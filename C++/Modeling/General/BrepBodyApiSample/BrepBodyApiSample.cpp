@@ -3,6 +3,7 @@
 #include <Core/Application/Document.h>
 #include <Core/Application/Documents.h>
 #include <Fusion/Components/Component.h>
+#include <Fusion/Components/Components.h>
 #include <Fusion/Fusion/Design.h>
 #include <Fusion/Sketch/Sketch.h>
 #include <Fusion/Sketch/Sketches.h>
@@ -18,6 +19,20 @@
 #include <Fusion/Features/ExtrudeFeature.h>
 #include <Fusion/BRep/BRepBodies.h>
 #include <Fusion/BRep/BRepBody.h>
+#include <Fusion/Fusion/PhysicalProperties.h>
+#include <Core/Geometry/BoundingBox3D.h>
+
+#include <algorithm>
+#include <ctime>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#ifndef XI_WIN
+#include <dlfcn.h>
+#endif
 
 
 using namespace adsk::core;
@@ -25,6 +40,249 @@ using namespace adsk::fusion;
 
 Ptr<UserInterface> ui;
 
+std::string getDllPath();
+
+// Values derived from a body which are expensive to compute.
+struct BodyDerivedValues
+{
+ double volume = 0.0;
+ double area = 0.0;
+ double minPoint[3] = { 0.0, 0.0, 0.0 };
+ double maxPoint[3] = { 0.0, 0.0, 0.0 };
+ double mass = 0.0;
+ double density = 0.0;
+ double centerOfMass[3] = { 0.0, 0.0, 0.0 };
+};
+
+// Caches the derived values of bodies keyed by the id of their component and their
+// name, which are kept with the design, unlike entity tokens. The revisionId of a body
+// changes whenever the body is modified, so a cached entry is only returned while the
+// body is unchanged. The cache can be saved to and loaded from a sidecar file so that
+// unchanged bodies cost nothing on the next run. The sidecar is shared by all the
+// designs, so it is capped by dropping the entries that were used the longest ago.
+class BodyDerivedValuesCache
+{
+public:
+ // Gets the derived values of the body, computing them only if the body is
+ // unknown or has been modified since they were cached.
+ bool get(const Ptr<BRepBody>& body, BodyDerivedValues& values)
+ {
+  if (!body)
+   return false;
+
+  std::string token = getKey(body);
+  if (token.empty())
+   return false;
+  std::string revisionId = body->revisionId();
+
+  long long now = static_cast<long long>(std::time(nullptr));
+  auto it = m_entries.find(token);
+  if (it != m_entries.end() && it->second.revisionId == revisionId)
+  {
+   ++m_hits;
+   values = it->second.values;
+   if (it->second.lastUsed != now)
+   {
+    it->second.lastUsed = now;
+    m_isDirty = true;
+   }
+   return true;
+  }
+
+  ++m_misses;
+  if (!compute(body, values))
+   return false;
+
+  // Replace any stale entry so that the cache holds one entry per body.
+  CacheEntry& entry = m_entries[token];
+  entry.revisionId = revisionId;
+  entry.values = values;
+  entry.lastUsed = now;
+  m_isDirty = true;
+  return true;
+ }
+
+ // Loads the entries stored in a sidecar file. A missing file is not an error. Lines
+ // that do not parse are skipped and make the load return false; the next save
+ // rewrites the file without them.
+ bool load(const std::string& sidecarPath)
+ {
+  m_entries.clear();
+  m_isDirty = false;
+  std::ifstream infile(sidecarPath);
+  if (!infile)
+   return true;
+
+  bool isValid = true;
+  std::string line;
+  while (getline(infile, line))
+  {
+   // The key holds a body name, which may contain spaces, so it ends at a tab.
+   size_t keyEnd = line.find('\t', line.find('\t') + 1);
+   if (keyEnd == std::string::npos)
+   {
+    isValid = false;
+    continue;
+   }
+   std::string token = line.substr(0, keyEnd);
+   std::istringstream ss(line.substr(keyEnd + 1));
+   CacheEntry entry;
+   BodyDerivedValues& v = entry.values;
+   ss >> entry.revisionId >> v.volume >> v.area
+    >> v.minPoint[0] >> v.minPoint[1] >> v.minPoint[2]
+    >> v.maxPoint[0] >> v.maxPoint[1] >> v.maxPoint[2]
+    >> v.mass >> v.density
+    >> v.centerOfMass[0] >> v.centerOfMass[1] >> v.centerOfMass[2]
+    >> entry.lastUsed;
+   if (!ss)
+   {
+    isValid = false;
+    continue;
+   }
+
+   m_entries[token] = entry;
+  }
+
+  m_isDirty = !isValid;
+  return isValid;
+ }
+
+ // Keeps only the maxEntryCount entries used most recently, in this run or in
+ // earlier ones, and returns the number of entries removed.
+ size_t trim(size_t maxEntryCount)
+ {
+  if (m_entries.size() <= maxEntryCount)
+   return 0;
+
+  std::vector<long long> lastUsedTimes;
+  lastUsedTimes.reserve(m_entries.size());
+  for (const auto& item : m_entries)
+   lastUsedTimes.push_back(item.second.lastUsed);
+  size_t removedCount = m_entries.size() - maxEntryCount;
+  std::nth_element(lastUsedTimes.begin(), lastUsedTimes.begin() + removedCount, lastUsedTimes.end());
+  long long oldestKept = lastUsedTimes[removedCount];
+
+  // Entries older than the oldest kept one go first, then ties as needed.
+  size_t count = 0;
+  for (auto it = m_entries.begin(); it != m_entries.end() && count < removedCount;)
+  {
+   if (it->second.lastUsed < oldestKept)
+   {
+    it = m_entries.erase(it);
+    ++count;
+   }
+   else
+   {
+    ++it;
+   }
+  }
+  for (auto it = m_entries.begin(); it != m_entries.end() && count < removedCount;)
+  {
+   if (it->second.lastUsed == oldestKept)
+   {
+    it = m_entries.erase(it);
+    ++count;
+   }
+   else
+   {
+    ++it;
+   }
+  }
+  m_isDirty = true;
+  return count;
+ }
+
+ // Writes all the entries to a sidecar file, only if something changed.
+ bool save(const std::string& sidecarPath)
+ {
+  if (!m_isDirty)
+   return true;
+
+  std::ofstream outfile(sidecarPath, std::ios::trunc);
+  if (!outfile)
+   return false;
+
+  outfile.precision(17);
+  for (const auto& item : m_entries)
+  {
+   const BodyDerivedValues& v = item.second.values;
+   outfile << item.first << "\t" << item.second.revisionId << " " << v.volume << " " << v.area << " "
+    << v.minPoint[0] << " " << v.minPoint[1] << " " << v.minPoint[2] << " "
+    << v.maxPoint[0] << " " << v.maxPoint[1] << " " << v.maxPoint[2] << " "
+    << v.mass << " " << v.density << " "
+    << v.centerOfMass[0] << " " << v.centerOfMass[1] << " " << v.centerOfMass[2] << " "
+    << item.second.lastUsed << "\n";
+  }
+
+  m_isDirty = !outfile.good();
+  return !m_isDirty;
+ }
+
+ size_t size() const { return m_entries.size(); }
+ size_t hits() const { return m_hits; }
+ size_t misses() const { return m_misses; }
+
+private:
+ struct CacheEntry
+ {
+  std::string revisionId;
+  BodyDerivedValues values;
+  // Time of the last get, in seconds since the epoch.
+  long long lastUsed = 0;
+ };
+
+ // Gets "componentId<tab>bodyName". Tabs and line breaks in the name are replaced,
+ // as they delimit the sidecar.
+ static std::string getKey(const Ptr<BRepBody>& body)
+ {
+  Ptr<Component> comp = body->parentComponent();
+  if (!comp)
+   return "";
+  std::string name = body->name();
+  for (size_t i = 0; i < name.size(); ++i)
+  {
+   if (name[i] == '\t' || name[i] == '\n' || name[i] == '\r')
+    name[i] = ' ';
+  }
+  return comp->id() + "\t" + name;
+ }
+
+ static bool compute(const Ptr<BRepBody>& body, BodyDerivedValues& values)
+ {
+  values.volume = body->volume();
+  values.area = body->area();
+
+  Ptr<BoundingBox3D> boundingBox = body->boundingBox();
+  if (!boundingBox)
+   return false;
+  Ptr<Point3D> minPoint = boundingBox->minPoint();
+  Ptr<Point3D> maxPoint = boundingBox->maxPoint();
+  if (!minPoint || !maxPoint)
+   return false;
+  minPoint->getData(values.minPoint[0], values.minPoint[1], values.minPoint[2]);
+  maxPoint->getData(values.maxPoint[0], values.maxPoint[1], values.maxPoint[2]);
+
+  Ptr<PhysicalProperties> physicalProperties = body->physicalProperties();
+  if (!physicalProperties)
+   return false;
+  values.mass = physicalProperties->mass();
+  values.density = physicalProperties->density();
+  Ptr<Point3D> cog = physicalProperties->centerOfMass();
+  if (!cog)
+   return false;
+  cog->getData(values.centerOfMass[0], values.centerOfMass[1], values.centerOfMass[2]);
+
+  return true;
+ }
+
+ // Revision ids never contain white spaces, so after the tab separated key the
+ // sidecar is a simple space separated text file.
+ std::unordered_map<std::string, CacheEntry> m_entries;
+ size_t m_hits = 0;
+ size_t m_misses = 0;
+ bool m_isDirty = false;
+};
+
 extern "C" XI_EXPORT bool run(const char* context)
 {
  Ptr<Application> app = Application::get();
@@ -35,18 +293,21 @@ extern "C" XI_EXPORT bool run(const char* context)
  if (!ui)
   return false;
 
- Ptr<Documents> docs = app->documents();
- if (!docs)
-  return false;
-
- // Create a document.
- Ptr<Document> doc = docs->add(DocumentTypes::FusionDesignDocumentType);
- if (!doc)
-  return false;
-
+ // Use the active design, so that the bodies of earlier runs are found in the cache,
+ // or create a document if there is none.
  Ptr<Design> design = app->activeProduct();
  if (!design)
-  return false;
+ {
+  Ptr<Documents> docs = app->documents();
+  if (!docs)
+   return false;
+  Ptr<Document> doc = docs->add(DocumentTypes::FusionDesignDocumentType);
+  if (!doc)
+   return false;
+  design = app->activeProduct();
+  if (!design)
+   return false;
+ }
 
  // Get the root component of the active design
  Ptr<Component> rootComp = design->rootComponent();
@@ -122,6 +383,53 @@ extern "C" XI_EXPORT bool run(const char* context)
  bool isVisibleFalse = brepBody->isLightBulbOn(false);
  std::string newRevisionId = brepBody->revisionId();
 
+ // Cache the derived values of the body, reusing the values stored by a previous run
+ BodyDerivedValuesCache cache;
+ std::string sidecarPath = getDllPath() + "/" + "BodyDerivedValues.cache";
+ if (!cache.load(sidecarPath))
+  ui->messageBox("Some lines of \"" + sidecarPath + "\" could not be read and were dropped.");
+
+ // Get the derived values of all the bodies of the design. The bodies that are
+ // unchanged since an earlier run are answered from the sidecar.
+ BodyDerivedValues values;
+ size_t bodyCount = 0;
+ Ptr<Components> comps = design->allComponents();
+ for (size_t i = 0; comps && i < comps->count(); ++i)
+ {
+  Ptr<Component> comp = comps->item(i);
+  if (!comp)
+   continue;
+  Ptr<BRepBodies> compBodies = comp->bRepBodies();
+  for (size_t j = 0; compBodies && j < compBodies->count(); ++j)
+  {
+   if (cache.get(compBodies->item(j), values))
+    ++bodyCount;
+  }
+ }
+ size_t designHits = cache.hits();
+ size_t designMisses = cache.misses();
+
+ if (!cache.get(brepBody, values))
+  return false;
+
+ // The body is unchanged, so the second query is answered from the cache
+ if (!cache.get(brepBody, values))
+  return false;
+
+ // Modifying the body changes its revisionId, so the values are computed again
+ brepBody->isLightBulbOn(true);
+ if (!cache.get(brepBody, values))
+  return false;
+
+ cache.trim(10000);
+ cache.save(sidecarPath);
+
+ std::stringstream message;
+ message << "Derived values of the " << bodyCount << " bodies of the design: " << designHits << " from the cache, "
+  << designMisses << " computed.\n";
+ message << "Derived values of the new body: " << cache.hits() - designHits << " from the cache, "
+  << cache.misses() - designMisses << " computed.";
+ ui->messageBox(message.str());
 
  return true;
 }
@@ -144,4 +452,33 @@ BOOL APIENTRY DllMain(HMODULE hmodule, DWORD reason, LPVOID reserved)
  return TRUE;
 }
 
-#endif // XI_WIN
\ No newline at end of file
+#endif // XI_WIN
+
+std::string getDllPath()
+{
+#if defined(_WINDOWS) || defined(_WIN32) || defined(_WIN64)
+ HMODULE hModule = NULL;
+ if (!GetModuleHandleExA(GET_MODULE_HANDLE_EX_FLAG_FROM_ADDRESS |
+  GET_MODULE_HANDLE_EX_FLAG_UNCHANGED_REFCOUNT,
+  (LPCSTR)&getDllPath,
+  &hModule))
+  return "";
+
+ char winTempPath[2048];
+ ::GetModuleFileNameA(hModule, winTempPath, 2048);
+
+ std::string strPath = winTempPath;
+ size_t stPos = strPath.rfind('\\');
+ return strPath.substr(0, stPos);
+#else
+ Dl_info info;
+ dladdr((void*)getDllPath, &info);
+
+ std::string strPath = info.dli_fname;
+ int stPos = (int)strPath.rfind('/');
+ if (stPos != -1)
+  return strPath.substr(0, stPos);
+ else
+  return "";
+#endif
+}
\ No newline at end of file
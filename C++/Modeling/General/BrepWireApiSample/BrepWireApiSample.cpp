@@ -20,6 +20,9 @@
 #include <Fusion/Components/Component.h>
 #include <Fusion/BRep/TemporaryBRepManager.h>
 
+#include <chrono>
+#include <vector>
+
 
 using namespace adsk::core;
 using namespace adsk::fusion;
@@ -27,6 +30,78 @@ using namespace adsk::fusion;
 Ptr<Application> app;
 Ptr<UserInterface> ui;
 
+// Result of one offset of a planar wire.
+struct WireOffsetResult
+{
+ double distance = 0.0;
+ Ptr<BRepBody> body;
+ double seconds = 0.0;
+};
+
+// Results of a batch of offsets of the same planar wire.
+struct WireOffsetStack
+{
+ std::vector<WireOffsetResult> offsets;
+ bool isCollapsed = false;
+ double totalSeconds = 0.0;
+};
+
+// An offset has collapsed when it does not produce any wire anymore.
+bool isOffsetCollapsed(const Ptr<BRepBody>& offsetBody)
+{
+ if (!offsetBody)
+  return true;
+
+ Ptr<BRepWires> wires = offsetBody->wires();
+ if (!wires || wires->count() == 0)
+  return true;
+
+ Ptr<BRepEdges> edges = offsetBody->edges();
+ return !edges || edges->count() == 0;
+}
+
+// Offsets a planar wire by each of the distances and collects all the resulting
+// wire bodies with the time spent on each offset. Every offset is computed from
+// the original wire so that errors do not accumulate. The distances are expected
+// to be ordered by increasing magnitude: once an offset collapses, the larger
+// ones would collapse too and the remaining distances are skipped.
+bool offsetPlanarWireByDistances(const Ptr<BRepWire>& wire,
+         const Ptr<Vector3D>& planeNormal,
+         const std::vector<double>& distances,
+         OffsetCornerTypes cornerType,
+         WireOffsetStack& stack)
+{
+ stack.offsets.clear();
+ stack.offsets.reserve(distances.size());
+ stack.isCollapsed = false;
+ stack.totalSeconds = 0.0;
+
+ if (!wire || !planeNormal)
+  return false;
+
+ for (double distance : distances)
+ {
+  std::chrono::steady_clock::time_point startTime = std::chrono::steady_clock::now();
+  Ptr<BRepBody> offsetBody = wire->offsetPlanarWire(planeNormal, distance, cornerType);
+  std::chrono::duration<double> elapsedSeconds = std::chrono::steady_clock::now() - startTime;
+  stack.totalSeconds += elapsedSeconds.count();
+
+  if (isOffsetCollapsed(offsetBody))
+  {
+   stack.isCollapsed = true;
+   break;
+  }
+
+  WireOffsetResult result;
+  result.distance = distance;
+  result.body = offsetBody;
+  result.seconds = elapsedSeconds.count();
+  stack.offsets.push_back(result);
+ }
+
+ return true;
+}
+
 Ptr<BRepBody> CreateWireBody(std::vector< Ptr<BRepEdge> > &edgeMap)
 {
  //Get TemporaryBRepManager
@@ -159,6 +234,15 @@ extern "C" XI_EXPORT bool run(const char* context)
  if (!offsetBody)
   return false;
 
+ // offset the planar brep wire by several distances at once, stopping when the offset collapses
+ std::vector<double> distances;
+ for (size_t i = 1; i <= 20; ++i)
+  distances.push_back(-0.25 * i);
+
+ WireOffsetStack offsetStack;
+ if (!offsetPlanarWireByDistances(brepWire, planeNormal, distances, OffsetCornerTypes::LinearOffsetCornerType, offsetStack))
+  return false;
+
  // Create brep wire proxy
  Ptr<BRepWire> wireProxy = brepWire->createForAssemblyContext(subOcc);
  if (!wireProxy)
@@ -5,6 +5,7 @@
 #include <Core/Application/ObjectCollection.h>
 #include <Core/Application/ValueInput.h>
 #include <Core/Geometry/Point3D.h>
+#include <Core/Geometry/BoundingBox3D.h>
 #include <Core/UserInterface/UserInterface.h>
 #include <Fusion/BRep/BRepBodies.h>
 #include <Fusion/BRep/BRepBody.h>
@@ -28,6 +29,21 @@
 #include <Fusion/Sketch/SketchCircles.h>
 #include <Fusion/Sketch/SketchPoint.h>
 #include <Fusion/Sketch/SketchPoints.h>
+#include <Fusion/Components/Occurrence.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#ifndef XI_WIN
+#include <dlfcn.h>
+#endif
 
 
 using namespace adsk::core;
@@ -35,6 +51,228 @@ using namespace adsk::fusion;
 
 Ptr<UserInterface> ui;
 
+std::string getDllPath();
+
+// Statistics of an interference analysis preceded by a bounding box check.
+struct BroadPhaseReport
+{
+ size_t totalPairCount = 0;
+ size_t candidatePairCount = 0;
+ size_t prunedPairCount = 0;
+ double broadPhaseSeconds = 0.0;
+ double exactSeconds = 0.0;
+};
+
+// Analyzes the interference one pair of bodies at a time, only for the pairs whose
+// bounding boxes overlap. The boxes are compared pair by pair, which is enough for a
+// few bodies; AnalyzeInterferenceApiSample sorts them with sweep and prune and
+// groups the candidates into clusters for assemblies with thousands of parts.
+bool analyzeOverlappingBodies(const Ptr<Design>& design, const Ptr<ObjectCollection>& bodies,
+ std::vector<Ptr<InterferenceResults>>& results, BroadPhaseReport& report)
+{
+ results.clear();
+ report = BroadPhaseReport();
+ if (!design || !bodies)
+  return false;
+
+ std::chrono::steady_clock::time_point startTime = std::chrono::steady_clock::now();
+
+ std::vector<Ptr<BoundingBox3D>> boxes;
+ for (size_t i = 0; i < bodies->count(); ++i)
+ {
+  Ptr<BRepBody> body = bodies->item(i);
+  if (!body)
+   return false;
+  Ptr<BoundingBox3D> box = body->boundingBox();
+  if (!box)
+   return false;
+  boxes.push_back(box);
+ }
+
+ std::vector<std::pair<size_t, size_t>> pairs;
+ for (size_t i = 0; i < boxes.size(); ++i)
+ {
+  for (size_t j = i + 1; j < boxes.size(); ++j)
+  {
+   if (boxes[i]->intersects(boxes[j]))
+    pairs.push_back(std::make_pair(i, j));
+  }
+ }
+
+ std::chrono::steady_clock::time_point broadPhaseEndTime = std::chrono::steady_clock::now();
+
+ report.totalPairCount = boxes.size() < 2 ? 0 : boxes.size() * (boxes.size() - 1) / 2;
+ report.candidatePairCount = pairs.size();
+ report.prunedPairCount = report.totalPairCount - report.candidatePairCount;
+ report.broadPhaseSeconds = std::chrono::duration<double>(broadPhaseEndTime - startTime).count();
+
+ for (const std::pair<size_t, size_t>& pair : pairs)
+ {
+  Ptr<ObjectCollection> pairBodies = ObjectCollection::create();
+  if (!pairBodies)
+   return false;
+  pairBodies->add(bodies->item(pair.first));
+  pairBodies->add(bodies->item(pair.second));
+
+  Ptr<InterferenceInput> input = design->createInterferenceInput(pairBodies);
+  if (!input)
+   return false;
+  Ptr<InterferenceResults> pairResults = design->analyzeInterference(input);
+  if (!pairResults)
+   return false;
+  results.push_back(pairResults);
+ }
+
+ report.exactSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - broadPhaseEndTime).count();
+ return true;
+}
+
+enum InterferenceReportFormat { CsvInterferenceReport, JsonInterferenceReport };
+
+// Gets the component and entity names of an interfering body or occurrence.
+void getInterferenceEntityNames(const Ptr<Base>& entity, std::string& componentName, std::string& entityName)
+{
+ componentName.clear();
+ entityName.clear();
+ if (Ptr<BRepBody> body = entity)
+ {
+  Ptr<Component> comp = body->parentComponent();
+  if (comp)
+   componentName = comp->name();
+  entityName = body->name();
+ }
+ else if (Ptr<Occurrence> occ = entity)
+ {
+  Ptr<Component> comp = occ->component();
+  if (comp)
+   componentName = comp->name();
+  entityName = occ->name();
+ }
+}
+
+std::string toCsvField(const std::string& value)
+{
+ std::string field = "\"";
+ for (char c : value)
+ {
+  if (c == '"')
+   field += '"';
+  field += c;
+ }
+ field += '"';
+ return field;
+}
+
+std::string toJsonString(const std::string& value)
+{
+ std::string result = "\"";
+ for (char c : value)
+ {
+  switch (c)
+  {
+  case '"': result += "\\\""; break;
+  case '\\': result += "\\\\"; break;
+  case '\n': result += "\\n"; break;
+  case '\r': result += "\\r"; break;
+  case '\t': result += "\\t"; break;
+  default:
+   if (static_cast<unsigned char>(c) < 0x20)
+   {
+    char escaped[8];
+    snprintf(escaped, sizeof(escaped), "\\u%04x", static_cast<unsigned char>(c));
+    result += escaped;
+   }
+   else
+    result += c;
+  }
+ }
+ result += '"';
+ return result;
+}
+
+// Walks the interference results of one or more analyses and writes one record per
+// result (interfering entities, their component names and the interference volume) as
+// soon as it is read, without creating any body in the design.
+bool writeInterferenceReport(const std::vector<Ptr<InterferenceResults>>& analyses, std::ostream& out,
+        InterferenceReportFormat format, size_t& resultCount)
+{
+ resultCount = 0;
+
+ out.precision(9);
+ if (format == CsvInterferenceReport)
+  out << "index,component1,entity1,component2,entity2,volume\n";
+ else
+  out << "[\n";
+
+ std::string comp1Name, entity1Name, comp2Name, entity2Name;
+ for (const Ptr<InterferenceResults>& results : analyses)
+ {
+  if (!results)
+   return false;
+  size_t count = results->count();
+  for (size_t j = 0; j < count; ++j)
+  {
+   Ptr<InterferenceResult> result = results->item(j);
+   if (!result)
+    return false;
+   size_t i = resultCount;
+
+   getInterferenceEntityNames(result->entityOne(), comp1Name, entity1Name);
+   getInterferenceEntityNames(result->entityTwo(), comp2Name, entity2Name);
+
+   double volume = 0.0;
+   Ptr<BRepBody> interferenceBody = result->interferenceBody();
+   if (interferenceBody)
+    volume = interferenceBody->volume();
+
+   if (format == CsvInterferenceReport)
+   {
+    out << i << "," << toCsvField(comp1Name) << "," << toCsvField(entity1Name) << ","
+     << toCsvField(comp2Name) << "," << toCsvField(entity2Name) << "," << volume << "\n";
+   }
+   else
+   {
+    out << (i > 0 ? ",\n" : "") << " {\"index\": " << i
+     << ", \"component1\": " << toJsonString(comp1Name) << ", \"entity1\": " << toJsonString(entity1Name)
+     << ", \"component2\": " << toJsonString(comp2Name) << ", \"entity2\": " << toJsonString(entity2Name)
+     << ", \"volume\": " << volume << "}";
+   }
+
+   ++resultCount;
+  }
+ }
+
+ if (format == JsonInterferenceReport)
+  out << "\n]\n";
+
+ out.flush();
+ return out.good();
+}
+
+// Flags only the first maxCreatedBodies results of the analyses, so that createBodies
+// on each of them creates at most that many bodies in all.
+bool flagCreatedBodies(const std::vector<Ptr<InterferenceResults>>& analyses, size_t maxCreatedBodies)
+{
+ size_t flaggedCount = 0;
+ for (const Ptr<InterferenceResults>& results : analyses)
+ {
+  if (!results)
+   return false;
+  size_t count = results->count();
+  for (size_t j = 0; j < count; ++j)
+  {
+   Ptr<InterferenceResult> result = results->item(j);
+   if (!result)
+    return false;
+   bool isCreated = flaggedCount < maxCreatedBodies;
+   result->isCreateBody(isCreated);
+   if (isCreated)
+    ++flaggedCount;
+  }
+ }
+ return true;
+}
+
 extern "C" XI_EXPORT bool run(const char* context)
 {
  Ptr<Application> app = Application::get();
@@ -172,18 +410,54 @@ extern "C" XI_EXPORT bool run(const char* context)
   bodies->add(body);
  }
 
- // Create InterferenceInput
- Ptr<InterferenceInput> input = design->createInterferenceInput(bodies);
- if(!input)
+ // Analyze interference, only between the bodies whose bounding boxes overlap
+ std::vector<Ptr<InterferenceResults>> results;
+ BroadPhaseReport broadPhaseReport;
+ if (!analyzeOverlappingBodies(design, bodies, results, broadPhaseReport))
+  return false;
+
+ // On request, also analyze all the bodies at once to measure the time saved.
+ double fullAnalysisSeconds = -1.0;
+ if (ui->messageBox("Also analyze all the bodies at once to measure the time saved?", "Interference",
+  MessageBoxButtonTypes::YesNoButtonType, MessageBoxIconTypes::QuestionIconType) == DialogResults::DialogYes)
+ {
+  std::chrono::steady_clock::time_point fullAnalysisStartTime = std::chrono::steady_clock::now();
+  Ptr<InterferenceInput> input = design->createInterferenceInput(bodies);
+  if (!input)
+   return false;
+  Ptr<InterferenceResults> fullResults = design->analyzeInterference(input);
+  if (!fullResults)
+   return false;
+  fullAnalysisSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - fullAnalysisStartTime).count();
+ }
+
+ // Report the interferences without creating any body
+ std::ofstream reportFile(getDllPath() + "/" + "InterferenceReport.csv", std::ios::trunc);
+ if (!reportFile)
+  return false;
+ size_t resultCount = 0;
+ if (!writeInterferenceReport(results, reportFile, CsvInterferenceReport, resultCount))
   return false;
 
- // Analyze interference
- Ptr<InterferenceResults> results = design->analyzeInterference(input);
- if(!input)
+ // Create bodies, only for the first 100 results
+ if (!flagCreatedBodies(results, 100))
   return false;
+ for (const Ptr<InterferenceResults>& analysisResults : results)
+  analysisResults->createBodies(false);
 
- // Create bodies
- results->createBodies(true);
+ std::stringstream message;
+ message << std::setprecision(3) << std::fixed;
+ message << resultCount << " interferences written to the report.\n";
+ double analysisSeconds = broadPhaseReport.broadPhaseSeconds + broadPhaseReport.exactSeconds;
+ message << "Candidate pairs: " << broadPhaseReport.candidatePairCount << " of " << broadPhaseReport.totalPairCount << "\n";
+ message << "Pruned pairs: " << broadPhaseReport.prunedPairCount << "\n";
+ message << "Analyzed in " << analysisSeconds << " s (" << broadPhaseReport.broadPhaseSeconds << " s of it comparing boxes)";
+ if (fullAnalysisSeconds >= 0.0)
+ {
+  message << "\nAll the bodies at once: " << fullAnalysisSeconds << " s\n";
+  message << "Time saved: " << std::max(0.0, fullAnalysisSeconds - analysisSeconds) << " s";
+ }
+ ui->messageBox(message.str());
 
  return true;
 }
@@ -206,4 +480,33 @@ BOOL APIENTRY DllMain(HMODULE hmodule, DWORD reason, LPVOID reserved)
  return TRUE;
 }
 
-#endif // XI_WIN
\ No newline at end of file
+#endif // XI_WIN
+
+std::string getDllPath()
+{
+#if defined(_WINDOWS) || defined(_WIN32) || defined(_WIN64)
+ HMODULE hModule = NULL;
+ if (!GetModuleHandleExA(GET_MODULE_HANDLE_EX_FLAG_FROM_ADDRESS |
+  GET_MODULE_HANDLE_EX_FLAG_UNCHANGED_REFCOUNT,
+  (LPCSTR)&getDllPath,
+  &hModule))
+  return "";
+
+ char winTempPath[2048];
+ ::GetModuleFileNameA(hModule, winTempPath, 2048);
+
+ std::string strPath = winTempPath;
+ size_t stPos = strPath.rfind('\\');
+ return strPath.substr(0, stPos);
+#else
+ Dl_info info;
+ dladdr((void*)getDllPath, &info);
+
+ std::string strPath = info.dli_fname;
+ int stPos = (int)strPath.rfind('/');
+ if (stPos != -1)
+  return strPath.substr(0, stPos);
+ else
+  return "";
+#endif
+}
\ No newline at end of file
@@ -18,7 +18,31 @@
 #include <Core/Materials/Appearances.h>
 #include <Core/Materials/Appearance.h>
 
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <limits>
+#include <queue>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
 
+#ifdef XI_WIN
+// Keep windows.h from defining min and max macros, which break std::min and std::max
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <dlfcn.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
 
 using namespace adsk::core;
 using namespace adsk::fusion;
@@ -28,6 +52,1198 @@ Ptr<UserInterface> ui;
 
 std::string getDllPath();
 
+// Read-only view of a whole file mapped in memory.
+class MappedFile
+{
+public:
+ ~MappedFile()
+ {
+  close();
+ }
+
+ bool open(const std::string& filePath)
+ {
+  close();
+#ifdef XI_WIN
+  m_file = CreateFileA(filePath.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+  if (m_file == INVALID_HANDLE_VALUE)
+   return false;
+  LARGE_INTEGER fileSize;
+  if (!GetFileSizeEx(m_file, &fileSize) || fileSize.QuadPart == 0)
+  {
+   close();
+   return false;
+  }
+  m_size = static_cast<size_t>(fileSize.QuadPart);
+  m_mapping = CreateFileMappingA(m_file, NULL, PAGE_READONLY, 0, 0, NULL);
+  if (!m_mapping)
+  {
+   close();
+   return false;
+  }
+  m_data = static_cast<const char*>(MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0));
+#else
+  m_file = ::open(filePath.c_str(), O_RDONLY);
+  if (m_file < 0)
+   return false;
+  struct stat fileStat;
+  if (fstat(m_file, &fileStat) != 0 || fileStat.st_size == 0)
+  {
+   close();
+   return false;
+  }
+  m_size = static_cast<size_t>(fileStat.st_size);
+  void* data = mmap(NULL, m_size, PROT_READ, MAP_PRIVATE, m_file, 0);
+  m_data = data != MAP_FAILED ? static_cast<const char*>(data) : nullptr;
+#endif
+  if (!m_data)
+  {
+   close();
+   return false;
+  }
+  return true;
+ }
+
+ void close()
+ {
+#ifdef XI_WIN
+  if (m_data)
+   UnmapViewOfFile(m_data);
+  if (m_mapping)
+   CloseHandle(m_mapping);
+  if (m_file != INVALID_HANDLE_VALUE)
+   CloseHandle(m_file);
+  m_mapping = NULL;
+  m_file = INVALID_HANDLE_VALUE;
+#else
+  if (m_data)
+   munmap(const_cast<char*>(m_data), m_size);
+  if (m_file >= 0)
+   ::close(m_file);
+  m_file = -1;
+#endif
+  m_data = nullptr;
+  m_size = 0;
+ }
+
+ const char* data() const { return m_data; }
+ size_t size() const { return m_size; }
+
+private:
+#ifdef XI_WIN
+ HANDLE m_file = INVALID_HANDLE_VALUE;
+ HANDLE m_mapping = NULL;
+#else
+ int m_file = -1;
+#endif
+ const char* m_data = nullptr;
+ size_t m_size = 0;
+};
+
+// Runs function(begin, end) on consecutive ranges of [0, count) on several threads.
+template <class Function>
+void parallelFor(size_t count, size_t threadCount, const Function& function)
+{
+ threadCount = std::max<size_t>(1, std::min(threadCount, count / 4096 + 1));
+ if (threadCount == 1)
+ {
+  function(0, count);
+  return;
+ }
+
+ std::vector<std::thread> threads;
+ size_t chunkSize = (count + threadCount - 1) / threadCount;
+ for (size_t begin = 0; begin < count; begin += chunkSize)
+  threads.push_back(std::thread(function, begin, std::min(count, begin + chunkSize)));
+ for (size_t i = 0; i < threads.size(); ++i)
+  threads[i].join();
+}
+
+size_t getThreadCount()
+{
+ return std::max<unsigned>(1, std::thread::hardware_concurrency());
+}
+
+// Triangles of an STL file in structure of arrays form: three corners per facet and
+// one normal, attribute word and color per facet. A color is 0xRRGGBBAA, 0 when the
+// facet has none.
+struct StlMesh
+{
+ std::string header;
+ bool isBinary = false;
+ std::vector<float> x, y, z;
+ std::vector<float> normalX, normalY, normalZ;
+ std::vector<uint16_t> attributes;
+ std::vector<uint32_t> colors;
+
+ size_t facetCount() const { return normalX.size(); }
+
+ void resize(size_t facetCount)
+ {
+  x.resize(facetCount * 3); y.resize(facetCount * 3); z.resize(facetCount * 3);
+  normalX.resize(facetCount); normalY.resize(facetCount); normalZ.resize(facetCount);
+  attributes.resize(facetCount);
+  colors.resize(facetCount);
+ }
+};
+
+uint32_t toColor(unsigned red, unsigned green, unsigned blue, unsigned alpha)
+{
+ return (red << 24) | (green << 16) | (blue << 8) | alpha;
+}
+
+// Decodes the 15 bit color of a facet attribute word. Materialise Magics files,
+// recognized by "COLOR=" in their header, store red in the low bits and clear bit 15
+// when the facet has its own color; otherwise the facet takes the default color of the
+// header. Other files (VisCAM, SolidView) store blue in the low bits and set bit 15
+// when the color is valid.
+uint32_t decodeFacetColor(uint16_t attribute, bool isMagicsColor, uint32_t defaultColor)
+{
+ unsigned low = (attribute & 0x1F) * 255 / 31;
+ unsigned middle = ((attribute >> 5) & 0x1F) * 255 / 31;
+ unsigned high = ((attribute >> 10) & 0x1F) * 255 / 31;
+ bool isValid = (attribute & 0x8000) != 0;
+ if (isMagicsColor)
+  return isValid ? defaultColor : toColor(low, middle, high, 255);
+ return isValid ? toColor(high, middle, low, 255) : 0;
+}
+
+// Parses the facets of a binary STL file on several threads.
+bool readBinaryStl(const char* data, size_t size, StlMesh& mesh)
+{
+ const size_t headerSize = 80, facetSize = 50;
+ uint32_t facetCount = 0;
+ memcpy(&facetCount, data + headerSize, sizeof(facetCount));
+ if (size < headerSize + 4 + facetCount * facetSize)
+  return false;
+
+ mesh.header.assign(data, headerSize);
+ mesh.isBinary = true;
+ mesh.resize(facetCount);
+
+ size_t colorPos = mesh.header.find("COLOR=");
+ bool isMagicsColor = colorPos != std::string::npos && colorPos + 10 <= headerSize;
+ uint32_t defaultColor = 0;
+ if (isMagicsColor)
+ {
+  const unsigned char* rgba = reinterpret_cast<const unsigned char*>(data + colorPos + 6);
+  defaultColor = toColor(rgba[0], rgba[1], rgba[2], rgba[3]);
+ }
+
+ const char* facets = data + headerSize + 4;
+ parallelFor(facetCount, getThreadCount(), [&](size_t begin, size_t end)
+ {
+  float values[12];
+  for (size_t i = begin; i < end; ++i)
+  {
+   const char* facet = facets + i * facetSize;
+   memcpy(values, facet, sizeof(values));
+   mesh.normalX[i] = values[0]; mesh.normalY[i] = values[1]; mesh.normalZ[i] = values[2];
+   for (size_t corner = 0; corner < 3; ++corner)
+   {
+    mesh.x[i * 3 + corner] = values[3 + corner * 3];
+    mesh.y[i * 3 + corner] = values[4 + corner * 3];
+    mesh.z[i * 3 + corner] = values[5 + corner * 3];
+   }
+   memcpy(&mesh.attributes[i], facet + sizeof(values), sizeof(uint16_t));
+   mesh.colors[i] = decodeFacetColor(mesh.attributes[i], isMagicsColor, defaultColor);
+  }
+ });
+ return true;
+}
+
+// Parses an ASCII STL file token by token, without loading it whole.
+bool readAsciiStl(const std::string& filePath, StlMesh& mesh)
+{
+ std::ifstream file(filePath.c_str());
+ if (!file)
+  return false;
+
+ mesh = StlMesh();
+ std::getline(file, mesh.header);
+ std::string token;
+ float normal[3] = { 0, 0, 0 };
+ size_t cornerCount = 0;
+ while (file >> token)
+ {
+  if (token == "normal")
+   file >> normal[0] >> normal[1] >> normal[2];
+  else if (token == "vertex")
+  {
+   float x = 0, y = 0, z = 0;
+   file >> x >> y >> z;
+   mesh.x.push_back(x); mesh.y.push_back(y); mesh.z.push_back(z);
+   ++cornerCount;
+  }
+  else if (token == "endfacet")
+  {
+   if (cornerCount != 3)
+    return false;
+   cornerCount = 0;
+   mesh.normalX.push_back(normal[0]); mesh.normalY.push_back(normal[1]); mesh.normalZ.push_back(normal[2]);
+   mesh.attributes.push_back(0);
+   mesh.colors.push_back(0);
+  }
+  if (file.fail())
+   return false;
+ }
+ return mesh.x.size() == mesh.facetCount() * 3;
+}
+
+// Reads a binary or ASCII STL file. A file starting with "solid" is still binary when
+// its size matches the facet count of its binary header, as some exporters write so.
+bool readStlFile(const std::string& filePath, StlMesh& mesh)
+{
+ MappedFile file;
+ if (!file.open(filePath))
+  return false;
+
+ if (file.size() >= 84)
+ {
+  uint32_t facetCount = 0;
+  memcpy(&facetCount, file.data() + 80, sizeof(facetCount));
+  if (file.size() == 84 + static_cast<size_t>(facetCount) * 50)
+   return readBinaryStl(file.data(), file.size(), mesh);
+ }
+ if (file.size() >= 5 && strncmp(file.data(), "solid", 5) == 0)
+ {
+  file.close();
+  return readAsciiStl(filePath, mesh);
+ }
+ return file.size() >= 84 && readBinaryStl(file.data(), file.size(), mesh);
+}
+
+// Shared vertices of a mesh and the facets found invalid.
+struct StlWeldResult
+{
+ std::vector<float> vertexX, vertexY, vertexZ;
+ // Three vertex indices per facet.
+ std::vector<uint32_t> facetVertices;
+ // 0 for a degenerate or duplicate facet.
+ std::vector<uint8_t> isFacetValid;
+ size_t degenerateCount = 0;
+ size_t duplicateCount = 0;
+};
+
+// Sorts the indices on several threads: each thread sorts a chunk, then the chunks are merged.
+template <class Less>
+void parallelSort(std::vector<uint32_t>& indices, size_t threadCount, const Less& less)
+{
+ size_t chunkCount = std::max<size_t>(1, std::min(threadCount, indices.size() / 65536 + 1));
+ size_t chunkSize = (indices.size() + chunkCount - 1) / chunkCount;
+ parallelFor(chunkCount, chunkCount, [&](size_t begin, size_t end)
+ {
+  for (size_t chunk = begin; chunk < end; ++chunk)
+   std::sort(indices.begin() + std::min(indices.size(), chunk * chunkSize), indices.begin() + std::min(indices.size(), (chunk + 1) * chunkSize), less);
+ });
+ for (size_t width = chunkSize; width < indices.size(); width *= 2)
+ {
+  for (size_t begin = 0; begin + width < indices.size(); begin += 2 * width)
+   std::inplace_merge(indices.begin() + begin, indices.begin() + begin + width, indices.begin() + std::min(indices.size(), begin + 2 * width), less);
+ }
+}
+
+// Merges the corners that fall in the same cell of a grid of the given tolerance, and
+// the corners of neighboring cells closer than the tolerance, so that two corners on
+// both sides of a cell boundary still merge. Then marks the facets whose corners merged
+// or whose area is zero as degenerate, and the facets using the same three vertices as
+// an earlier one as duplicates.
+void weldAndValidateStlMesh(const StlMesh& mesh, float tolerance, StlWeldResult& result)
+{
+ size_t threadCount = getThreadCount();
+ size_t cornerCount = mesh.x.size();
+ size_t facetCount = mesh.facetCount();
+ result = StlWeldResult();
+
+ // Quantize the corners. The cells are 64 bit, as a small tolerance puts coordinates of
+ // a few thousand units past the range of 32 bit cells.
+ std::vector<int64_t> cellX(cornerCount), cellY(cornerCount), cellZ(cornerCount);
+ double scale = tolerance > 0 ? 1.0 / tolerance : 1.0;
+ parallelFor(cornerCount, threadCount, [&](size_t begin, size_t end)
+ {
+  for (size_t i = begin; i < end; ++i)
+  {
+   cellX[i] = static_cast<int64_t>(floor(mesh.x[i] * scale));
+   cellY[i] = static_cast<int64_t>(floor(mesh.y[i] * scale));
+   cellZ[i] = static_cast<int64_t>(floor(mesh.z[i] * scale));
+  }
+ });
+
+ // Sort the corners by cell and number the cells.
+ std::vector<uint32_t> order(cornerCount);
+ for (size_t i = 0; i < cornerCount; ++i)
+  order[i] = static_cast<uint32_t>(i);
+ auto isCellLess = [&](uint32_t a, uint32_t b)
+ {
+  if (cellX[a] != cellX[b]) return cellX[a] < cellX[b];
+  if (cellY[a] != cellY[b]) return cellY[a] < cellY[b];
+  return cellZ[a] < cellZ[b];
+ };
+ parallelSort(order, threadCount, isCellLess);
+ // Position in order of the first corner of each cell, plus the end.
+ std::vector<uint32_t> cellStarts;
+ for (size_t i = 0; i < cornerCount; ++i)
+ {
+  if (i == 0 || isCellLess(order[i - 1], order[i]))
+   cellStarts.push_back(static_cast<uint32_t>(i));
+ }
+ size_t cellCount = cellStarts.size();
+ cellStarts.push_back(static_cast<uint32_t>(cornerCount));
+
+ // Probe the 13 neighbors of each cell that come after it in sort order, and record
+ // those holding a corner within the tolerance of a corner of the cell.
+ const int neighborCount = 13;
+ const uint32_t noCell = std::numeric_limits<uint32_t>::max();
+ std::vector<uint32_t> closeNeighbors(cellCount * neighborCount, noCell);
+ double squaredTolerance = static_cast<double>(tolerance) * tolerance;
+ parallelFor(cellCount, threadCount, [&](size_t begin, size_t end)
+ {
+  for (size_t cell = begin; cell < end; ++cell)
+  {
+   uint32_t first = order[cellStarts[cell]];
+   int neighbor = 0;
+   for (int dx = 0; dx <= 1; ++dx)
+   {
+    for (int dy = dx == 0 ? 0 : -1; dy <= 1; ++dy)
+    {
+     for (int dz = dx == 0 && dy == 0 ? 1 : -1; dz <= 1; ++dz, ++neighbor)
+     {
+      int64_t x = cellX[first] + dx, y = cellY[first] + dy, z = cellZ[first] + dz;
+      auto found = std::lower_bound(cellStarts.begin() + cell + 1, cellStarts.begin() + cellCount, 0, [&](uint32_t start, int)
+      {
+       uint32_t corner = order[start];
+       if (cellX[corner] != x) return cellX[corner] < x;
+       if (cellY[corner] != y) return cellY[corner] < y;
+       return cellZ[corner] < z;
+      });
+      if (found == cellStarts.begin() + cellCount)
+       continue;
+      uint32_t other = order[*found];
+      if (cellX[other] != x || cellY[other] != y || cellZ[other] != z)
+       continue;
+      size_t otherCell = found - cellStarts.begin();
+      bool isClose = false;
+      for (uint32_t i = cellStarts[cell]; i < cellStarts[cell + 1] && !isClose; ++i)
+      {
+       for (uint32_t j = cellStarts[otherCell]; j < cellStarts[otherCell + 1] && !isClose; ++j)
+       {
+        double ex = static_cast<double>(mesh.x[order[i]]) - mesh.x[order[j]];
+        double ey = static_cast<double>(mesh.y[order[i]]) - mesh.y[order[j]];
+        double ez = static_cast<double>(mesh.z[order[i]]) - mesh.z[order[j]];
+        isClose = ex * ex + ey * ey + ez * ez <= squaredTolerance;
+       }
+      }
+      if (isClose)
+       closeNeighbors[cell * neighborCount + neighbor] = static_cast<uint32_t>(otherCell);
+     }
+    }
+   }
+  }
+ });
+
+ // Group the close cells, the group taking the first cell in sort order as its root.
+ std::vector<uint32_t> cellRoots(cellCount);
+ for (size_t cell = 0; cell < cellCount; ++cell)
+  cellRoots[cell] = static_cast<uint32_t>(cell);
+ auto findRoot = [&](uint32_t cell)
+ {
+  while (cellRoots[cell] != cell)
+  {
+   cellRoots[cell] = cellRoots[cellRoots[cell]];
+   cell = cellRoots[cell];
+  }
+  return cell;
+ };
+ for (size_t i = 0; i < closeNeighbors.size(); ++i)
+ {
+  if (closeNeighbors[i] == noCell)
+   continue;
+  uint32_t root1 = findRoot(static_cast<uint32_t>(i / neighborCount));
+  uint32_t root2 = findRoot(closeNeighbors[i]);
+  if (root1 != root2)
+   cellRoots[std::max(root1, root2)] = std::min(root1, root2);
+ }
+
+ // One vertex per group, at the first corner of its root cell.
+ std::vector<uint32_t> cellVertices(cellCount);
+ result.facetVertices.resize(cornerCount);
+ for (size_t cell = 0; cell < cellCount; ++cell)
+ {
+  uint32_t root = findRoot(static_cast<uint32_t>(cell));
+  if (root == cell)
+  {
+   uint32_t corner = order[cellStarts[cell]];
+   cellVertices[cell] = static_cast<uint32_t>(result.vertexX.size());
+   result.vertexX.push_back(mesh.x[corner]);
+   result.vertexY.push_back(mesh.y[corner]);
+   result.vertexZ.push_back(mesh.z[corner]);
+  }
+  else
+   cellVertices[cell] = cellVertices[root];
+  for (uint32_t i = cellStarts[cell]; i < cellStarts[cell + 1]; ++i)
+   result.facetVertices[order[i]] = cellVertices[cell];
+ }
+
+ // Find the degenerate facets.
+ result.isFacetValid.assign(facetCount, 1);
+ parallelFor(facetCount, threadCount, [&](size_t begin, size_t end)
+ {
+  for (size_t i = begin; i < end; ++i)
+  {
+   const uint32_t* v = &result.facetVertices[i * 3];
+   if (v[0] == v[1] || v[1] == v[2] || v[0] == v[2])
+   {
+    result.isFacetValid[i] = 0;
+    continue;
+   }
+   double ax = result.vertexX[v[1]] - result.vertexX[v[0]], ay = result.vertexY[v[1]] - result.vertexY[v[0]], az = result.vertexZ[v[1]] - result.vertexZ[v[0]];
+   double bx = result.vertexX[v[2]] - result.vertexX[v[0]], by = result.vertexY[v[2]] - result.vertexY[v[0]], bz = result.vertexZ[v[2]] - result.vertexZ[v[0]];
+   double cx = ay * bz - az * by, cy = az * bx - ax * bz, cz = ax * by - ay * bx;
+   if (cx * cx + cy * cy + cz * cz == 0.0)
+    result.isFacetValid[i] = 0;
+  }
+ });
+ for (size_t i = 0; i < facetCount; ++i)
+  result.degenerateCount += result.isFacetValid[i] ? 0 : 1;
+
+ // Find the duplicate facets, whatever the order of their vertices.
+ std::vector<uint32_t> sortedVertices(result.facetVertices);
+ parallelFor(facetCount, threadCount, [&](size_t begin, size_t end)
+ {
+  for (size_t i = begin; i < end; ++i)
+   std::sort(sortedVertices.begin() + i * 3, sortedVertices.begin() + i * 3 + 3);
+ });
+ std::vector<uint32_t> facetOrder;
+ for (size_t i = 0; i < facetCount; ++i)
+ {
+  if (result.isFacetValid[i])
+   facetOrder.push_back(static_cast<uint32_t>(i));
+ }
+ parallelSort(facetOrder, threadCount, [&](uint32_t a, uint32_t b)
+ {
+  const uint32_t* va = &sortedVertices[a * 3];
+  const uint32_t* vb = &sortedVertices[b * 3];
+  if (va[0] != vb[0]) return va[0] < vb[0];
+  if (va[1] != vb[1]) return va[1] < vb[1];
+  if (va[2] != vb[2]) return va[2] < vb[2];
+  return a < b;
+ });
+ for (size_t i = 1; i < facetOrder.size(); ++i)
+ {
+  if (std::equal(sortedVertices.begin() + facetOrder[i] * 3, sortedVertices.begin() + facetOrder[i] * 3 + 3, sortedVertices.begin() + facetOrder[i - 1] * 3))
+  {
+   result.isFacetValid[facetOrder[i]] = 0;
+   ++result.duplicateCount;
+  }
+ }
+}
+
+// Triangle mesh with shared vertices, three vertex indices per facet.
+struct IndexedMesh
+{
+ std::vector<float> x, y, z;
+ std::vector<uint32_t> facetVertices;
+
+ size_t facetCount() const { return facetVertices.size() / 3; }
+};
+
+// Gets the valid facets of a welded STL mesh.
+void getIndexedMesh(const StlWeldResult& weldResult, IndexedMesh& mesh)
+{
+ mesh.x = weldResult.vertexX;
+ mesh.y = weldResult.vertexY;
+ mesh.z = weldResult.vertexZ;
+ mesh.facetVertices.clear();
+ for (size_t i = 0; i < weldResult.isFacetValid.size(); ++i)
+ {
+  if (weldResult.isFacetValid[i])
+   mesh.facetVertices.insert(mesh.facetVertices.end(), weldResult.facetVertices.begin() + i * 3, weldResult.facetVertices.begin() + i * 3 + 3);
+ }
+}
+
+// Writes a binary STL file with the normals computed from the facets.
+bool writeBinaryStl(const std::string& filePath, const IndexedMesh& mesh)
+{
+ std::ofstream file(filePath.c_str(), std::ios::binary | std::ios::trunc);
+ if (!file)
+  return false;
+
+ char header[80] = "Decimated mesh";
+ uint32_t facetCount = static_cast<uint32_t>(mesh.facetCount());
+ file.write(header, sizeof(header));
+ file.write(reinterpret_cast<const char*>(&facetCount), sizeof(facetCount));
+ std::vector<char> buffer(50 * 4096);
+ for (size_t first = 0; first < facetCount; first += 4096)
+ {
+  size_t last = std::min<size_t>(facetCount, first + 4096);
+  for (size_t i = first; i < last; ++i)
+  {
+   const uint32_t* v = &mesh.facetVertices[i * 3];
+   float values[12];
+   float ax = mesh.x[v[1]] - mesh.x[v[0]], ay = mesh.y[v[1]] - mesh.y[v[0]], az = mesh.z[v[1]] - mesh.z[v[0]];
+   float bx = mesh.x[v[2]] - mesh.x[v[0]], by = mesh.y[v[2]] - mesh.y[v[0]], bz = mesh.z[v[2]] - mesh.z[v[0]];
+   float nx = ay * bz - az * by, ny = az * bx - ax * bz, nz = ax * by - ay * bx;
+   float length = sqrt(nx * nx + ny * ny + nz * nz);
+   values[0] = length > 0 ? nx / length : 0; values[1] = length > 0 ? ny / length : 0; values[2] = length > 0 ? nz / length : 0;
+   for (size_t corner = 0; corner < 3; ++corner)
+   {
+    values[3 + corner * 3] = mesh.x[v[corner]];
+    values[4 + corner * 3] = mesh.y[v[corner]];
+    values[5 + corner * 3] = mesh.z[v[corner]];
+   }
+   char* record = &buffer[(i - first) * 50];
+   memcpy(record, values, sizeof(values));
+   memset(record + sizeof(values), 0, sizeof(uint16_t));
+  }
+  file.write(buffer.data(), (last - first) * 50);
+ }
+ return file.good();
+}
+
+// Error quadric of a vertex: the symmetric matrix of the sum of the squared distances
+// to the planes of its facets, stored as xx, xy, xz, xw, yy, yz, yw, zz, zw, ww.
+struct Quadric
+{
+ double m[10];
+
+ Quadric()
+ {
+  std::fill(m, m + 10, 0.0);
+ }
+
+ Quadric(double a, double b, double c, double d, double weight)
+ {
+  m[0] = weight * a * a; m[1] = weight * a * b; m[2] = weight * a * c; m[3] = weight * a * d;
+  m[4] = weight * b * b; m[5] = weight * b * c; m[6] = weight * b * d;
+  m[7] = weight * c * c; m[8] = weight * c * d;
+  m[9] = weight * d * d;
+ }
+
+ Quadric& operator+=(const Quadric& other)
+ {
+  for (size_t i = 0; i < 10; ++i)
+   m[i] += other.m[i];
+  return *this;
+ }
+
+ double evaluate(double x, double y, double z) const
+ {
+  return m[0] * x * x + 2 * m[1] * x * y + 2 * m[2] * x * z + 2 * m[3] * x
+   + m[4] * y * y + 2 * m[5] * y * z + 2 * m[6] * y
+   + m[7] * z * z + 2 * m[8] * z + m[9];
+ }
+
+ // Gets the point of least error, if the quadric is not singular.
+ bool getOptimalPoint(double& x, double& y, double& z) const
+ {
+  double a = m[0], b = m[1], c = m[2], d = m[4], e = m[5], f = m[7];
+  double determinant = a * (d * f - e * e) - b * (b * f - e * c) + c * (b * e - d * c);
+  if (fabs(determinant) < 1.0e-12)
+   return false;
+  double u = -m[3], v = -m[6], w = -m[8];
+  x = (u * (d * f - e * e) - b * (v * f - e * w) + c * (v * e - d * w)) / determinant;
+  y = (a * (v * f - e * w) - u * (b * f - e * c) + c * (b * w - v * c)) / determinant;
+  z = (a * (d * w - v * e) - b * (b * w - v * c) + u * (b * e - d * c)) / determinant;
+  return true;
+ }
+};
+
+struct DecimationOptions
+{
+ // Number of facets to reach; the decimation also stops at maxError.
+ size_t targetFacetCount = 0;
+ // Largest distance a collapse may move the surface, in the units of the mesh.
+ double maxError = std::numeric_limits<double>::infinity();
+};
+
+struct DecimationReport
+{
+ size_t inputFacetCount = 0;
+ size_t outputFacetCount = 0;
+ // Symmetric Hausdorff distance, sampled at the vertices of both meshes.
+ double hausdorffDistance = 0.0;
+ double seconds = 0.0;
+};
+
+// Decimates a mesh by quadric error edge collapse. The facets are split into slabs
+// along the longest side of the mesh, one per thread. A vertex used by several slabs
+// is locked, so each thread collapses the edges of its own slab without locks.
+// The facets around each vertex are kept in compressed rows built once; a vertex
+// collapsed into another is linked into its ring of merged vertices, whose rows then
+// hold the facets of the kept vertex. Boundary edges are held in place by the quadrics
+// of planes perpendicular to their facet, and a collapse must meet the link condition
+// so that it keeps the mesh manifold.
+class MeshDecimator
+{
+public:
+ MeshDecimator(const IndexedMesh& input, const DecimationOptions& options) : m_options(options),
+  m_x(input.x.begin(), input.x.end()), m_y(input.y.begin(), input.y.end()), m_z(input.z.begin(), input.z.end()),
+  m_facetVertices(input.facetVertices)
+ {
+ }
+
+ void run(IndexedMesh& output)
+ {
+  size_t vertexCount = m_x.size(), facetCount = m_facetVertices.size() / 3;
+  m_isFacetAlive.assign(facetCount, 1);
+  m_vertexStamps.assign(vertexCount, 0);
+  m_quadrics.assign(vertexCount, Quadric());
+  m_isVertexOnBoundary.assign(vertexCount, 0);
+
+  // Gather the facets around each vertex in compressed rows.
+  m_facetOffsets.assign(vertexCount + 1, 0);
+  for (size_t i = 0; i < m_facetVertices.size(); ++i)
+   ++m_facetOffsets[m_facetVertices[i] + 1];
+  for (size_t vertex = 0; vertex < vertexCount; ++vertex)
+   m_facetOffsets[vertex + 1] += m_facetOffsets[vertex];
+  m_adjacentFacets.resize(m_facetVertices.size());
+  std::vector<uint32_t> rowEnds(m_facetOffsets.begin(), m_facetOffsets.end() - 1);
+  for (size_t i = 0; i < m_facetVertices.size(); ++i)
+   m_adjacentFacets[rowEnds[m_facetVertices[i]]++] = static_cast<uint32_t>(i / 3);
+  m_nextMerged.resize(vertexCount);
+  for (size_t vertex = 0; vertex < vertexCount; ++vertex)
+   m_nextMerged[vertex] = static_cast<uint32_t>(vertex);
+
+  // Sum on each vertex the area weighted plane quadrics of its facets, and the quadrics
+  // of the planes perpendicular to the facets along its boundary edges.
+  const double boundaryWeight = 1000.0;
+  parallelFor(vertexCount, getThreadCount(), [&](size_t begin, size_t end)
+  {
+   for (size_t vertex = begin; vertex < end; ++vertex)
+   {
+    for (uint32_t k = m_facetOffsets[vertex]; k < m_facetOffsets[vertex + 1]; ++k)
+    {
+     const uint32_t* v = &m_facetVertices[m_adjacentFacets[k] * 3];
+     double normal[3];
+     double area = getFacetNormal(v, m_x[v[0]], m_y[v[0]], m_z[v[0]], normal);
+     double d = -(normal[0] * m_x[v[0]] + normal[1] * m_y[v[0]] + normal[2] * m_z[v[0]]);
+     m_quadrics[vertex] += Quadric(normal[0], normal[1], normal[2], d, area);
+
+     size_t corner = v[0] == vertex ? 0 : (v[1] == vertex ? 1 : 2);
+     uint32_t edges[2][2] = { { v[corner], v[(corner + 1) % 3] }, { v[(corner + 2) % 3], v[corner] } };
+     for (size_t e = 0; e < 2; ++e)
+     {
+      if (getEdgeFacetCount(edges[e][0], edges[e][1]) != 1)
+       continue;
+      m_isVertexOnBoundary[vertex] = 1;
+      double edge[3] = { m_x[edges[e][1]] - m_x[edges[e][0]], m_y[edges[e][1]] - m_y[edges[e][0]], m_z[edges[e][1]] - m_z[edges[e][0]] };
+      double planeNormal[3] = { edge[1] * normal[2] - edge[2] * normal[1], edge[2] * normal[0] - edge[0] * normal[2], edge[0] * normal[1] - edge[1] * normal[0] };
+      double length = sqrt(planeNormal[0] * planeNormal[0] + planeNormal[1] * planeNormal[1] + planeNormal[2] * planeNormal[2]);
+      if (length <= 0.0)
+       continue;
+      for (size_t i = 0; i < 3; ++i)
+       planeNormal[i] /= length;
+      double planeD = -(planeNormal[0] * m_x[vertex] + planeNormal[1] * m_y[vertex] + planeNormal[2] * m_z[vertex]);
+      double squaredLength = edge[0] * edge[0] + edge[1] * edge[1] + edge[2] * edge[2];
+      m_quadrics[vertex] += Quadric(planeNormal[0], planeNormal[1], planeNormal[2], planeD, boundaryWeight * squaredLength);
+     }
+    }
+   }
+  });
+
+  // Split the facets into slabs of equal size by their centroid and lock the vertices between slabs.
+  size_t slabCount = std::max<size_t>(1, std::min(getThreadCount(), facetCount / 1024));
+  std::vector< std::vector<uint32_t> > slabFacets(slabCount);
+  std::vector<uint32_t> slabOfFacet(facetCount, 0);
+  if (slabCount > 1)
+  {
+   size_t axis = getLongestAxis();
+   std::vector<float> centroids(facetCount);
+   for (size_t i = 0; i < facetCount; ++i)
+   {
+    const uint32_t* v = &m_facetVertices[i * 3];
+    centroids[i] = (getCoordinate(v[0], axis) + getCoordinate(v[1], axis) + getCoordinate(v[2], axis)) / 3;
+   }
+   std::vector<uint32_t> order(facetCount);
+   for (size_t i = 0; i < facetCount; ++i)
+    order[i] = static_cast<uint32_t>(i);
+   std::sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) { return centroids[a] < centroids[b]; });
+   for (size_t i = 0; i < facetCount; ++i)
+    slabOfFacet[order[i]] = static_cast<uint32_t>(i * slabCount / facetCount);
+  }
+  for (size_t i = 0; i < facetCount; ++i)
+   slabFacets[slabOfFacet[i]].push_back(static_cast<uint32_t>(i));
+  m_isVertexLocked.assign(vertexCount, 0);
+  for (size_t vertex = 0; vertex < vertexCount; ++vertex)
+  {
+   for (uint32_t k = m_facetOffsets[vertex] + 1; k < m_facetOffsets[vertex + 1] && !m_isVertexLocked[vertex]; ++k)
+    m_isVertexLocked[vertex] = slabOfFacet[m_adjacentFacets[k]] != slabOfFacet[m_adjacentFacets[m_facetOffsets[vertex]]];
+  }
+
+  parallelFor(slabCount, slabCount, [&](size_t begin, size_t end)
+  {
+   for (size_t slab = begin; slab < end; ++slab)
+   {
+    size_t removeCount = 0;
+    if (m_options.targetFacetCount < facetCount)
+     removeCount = (facetCount - m_options.targetFacetCount) * slabFacets[slab].size() / facetCount;
+    decimateSlab(slabFacets[slab], removeCount);
+   }
+  });
+
+  // Keep the facets left and the vertices they use.
+  output = IndexedMesh();
+  const uint32_t noVertex = 0xFFFFFFFF;
+  std::vector<uint32_t> newIndices(vertexCount, noVertex);
+  for (size_t i = 0; i < facetCount; ++i)
+  {
+   if (!m_isFacetAlive[i])
+    continue;
+   for (size_t corner = 0; corner < 3; ++corner)
+   {
+    uint32_t vertex = m_facetVertices[i * 3 + corner];
+    if (newIndices[vertex] == noVertex)
+    {
+     newIndices[vertex] = static_cast<uint32_t>(output.x.size());
+     output.x.push_back(static_cast<float>(m_x[vertex]));
+     output.y.push_back(static_cast<float>(m_y[vertex]));
+     output.z.push_back(static_cast<float>(m_z[vertex]));
+    }
+    output.facetVertices.push_back(newIndices[vertex]);
+   }
+  }
+ }
+
+private:
+ struct Collapse
+ {
+  double cost;
+  uint32_t vertexOne, vertexTwo;
+  uint32_t stampOne, stampTwo;
+  double x, y, z;
+
+  bool operator<(const Collapse& other) const { return cost > other.cost; }
+ };
+
+ // Calls function(facet) for each live facet around the vertex, going through the
+ // rows of all the vertices merged into it.
+ template <class Function>
+ void forEachFacet(uint32_t vertex, const Function& function) const
+ {
+  uint32_t merged = vertex;
+  do
+  {
+   for (uint32_t k = m_facetOffsets[merged]; k < m_facetOffsets[merged + 1]; ++k)
+   {
+    if (m_isFacetAlive[m_adjacentFacets[k]])
+     function(m_adjacentFacets[k]);
+   }
+   merged = m_nextMerged[merged];
+  } while (merged != vertex);
+ }
+
+ bool hasVertex(uint32_t facet, uint32_t vertex) const
+ {
+  const uint32_t* v = &m_facetVertices[facet * 3];
+  return v[0] == vertex || v[1] == vertex || v[2] == vertex;
+ }
+
+ // Gets the number of live facets using the edge: 1 on a boundary, 2 inside.
+ size_t getEdgeFacetCount(uint32_t vertexOne, uint32_t vertexTwo) const
+ {
+  size_t count = 0;
+  forEachFacet(vertexOne, [&](uint32_t facet)
+  {
+   if (hasVertex(facet, vertexTwo))
+    ++count;
+  });
+  return count;
+ }
+
+ // Checks the link condition: the vertices adjacent to both ends of the edge must be
+ // the opposite vertices of its facets, or the collapse would pinch the surface. An
+ // edge between two boundary vertices must itself be a boundary edge.
+ bool isLinkConditionMet(uint32_t vertexOne, uint32_t vertexTwo) const
+ {
+  std::vector<uint32_t> neighbors[2];
+  uint32_t ends[2] = { vertexOne, vertexTwo };
+  size_t edgeFacetCount = 0;
+  for (size_t side = 0; side < 2; ++side)
+  {
+   forEachFacet(ends[side], [&](uint32_t facet)
+   {
+    const uint32_t* v = &m_facetVertices[facet * 3];
+    if (side == 0 && hasVertex(facet, vertexTwo))
+     ++edgeFacetCount;
+    for (size_t corner = 0; corner < 3; ++corner)
+    {
+     if (v[corner] != vertexOne && v[corner] != vertexTwo)
+      neighbors[side].push_back(v[corner]);
+    }
+   });
+   std::sort(neighbors[side].begin(), neighbors[side].end());
+   neighbors[side].erase(std::unique(neighbors[side].begin(), neighbors[side].end()), neighbors[side].end());
+  }
+  if (edgeFacetCount == 0)
+   return false;
+  if (m_isVertexOnBoundary[vertexOne] && m_isVertexOnBoundary[vertexTwo] && edgeFacetCount != 1)
+   return false;
+
+  size_t commonCount = 0;
+  for (size_t i = 0, j = 0; i < neighbors[0].size() && j < neighbors[1].size();)
+  {
+   if (neighbors[0][i] < neighbors[1][j])
+    ++i;
+   else if (neighbors[1][j] < neighbors[0][i])
+    ++j;
+   else
+   {
+    ++commonCount;
+    ++i;
+    ++j;
+   }
+  }
+  return commonCount == edgeFacetCount;
+ }
+
+ double getCoordinate(uint32_t vertex, size_t axis) const
+ {
+  return axis == 0 ? m_x[vertex] : (axis == 1 ? m_y[vertex] : m_z[vertex]);
+ }
+
+ size_t getLongestAxis() const
+ {
+  double extents[3];
+  const std::vector<double>* coordinates[3] = { &m_x, &m_y, &m_z };
+  for (size_t axis = 0; axis < 3; ++axis)
+  {
+   std::pair<std::vector<double>::const_iterator, std::vector<double>::const_iterator> range = std::minmax_element(coordinates[axis]->begin(), coordinates[axis]->end());
+   extents[axis] = range.first != coordinates[axis]->end() ? *range.second - *range.first : 0.0;
+  }
+  return std::max_element(extents, extents + 3) - extents;
+ }
+
+ // Gets the unit normal of the facet, with the first vertex moved to (x, y, z), and returns its area.
+ double getFacetNormal(const uint32_t* v, double x, double y, double z, double* normal) const
+ {
+  double ax = m_x[v[1]] - x, ay = m_y[v[1]] - y, az = m_z[v[1]] - z;
+  double bx = m_x[v[2]] - x, by = m_y[v[2]] - y, bz = m_z[v[2]] - z;
+  normal[0] = ay * bz - az * by; normal[1] = az * bx - ax * bz; normal[2] = ax * by - ay * bx;
+  double length = sqrt(normal[0] * normal[0] + normal[1] * normal[1] + normal[2] * normal[2]);
+  for (size_t i = 0; i < 3; ++i)
+   normal[i] = length > 0 ? normal[i] / length : 0.0;
+  return length / 2;
+ }
+
+ // Gets the cost and the position of the collapse of an edge.
+ bool getCollapse(uint32_t vertexOne, uint32_t vertexTwo, Collapse& collapse) const
+ {
+  if (m_isVertexLocked[vertexOne] || m_isVertexLocked[vertexTwo])
+   return false;
+  Quadric quadric = m_quadrics[vertexOne];
+  quadric += m_quadrics[vertexTwo];
+  collapse.vertexOne = vertexOne;
+  collapse.vertexTwo = vertexTwo;
+  collapse.stampOne = m_vertexStamps[vertexOne];
+  collapse.stampTwo = m_vertexStamps[vertexTwo];
+  if (!quadric.getOptimalPoint(collapse.x, collapse.y, collapse.z))
+  {
+   collapse.x = (m_x[vertexOne] + m_x[vertexTwo]) / 2;
+   collapse.y = (m_y[vertexOne] + m_y[vertexTwo]) / 2;
+   collapse.z = (m_z[vertexOne] + m_z[vertexTwo]) / 2;
+  }
+  collapse.cost = std::max(0.0, quadric.evaluate(collapse.x, collapse.y, collapse.z));
+  return true;
+ }
+
+ // Checks that moving the vertex to the collapse position flips none of its facets
+ // that the collapse keeps.
+ bool isCollapseValid(uint32_t vertex, uint32_t otherVertex, const Collapse& collapse) const
+ {
+  bool isValid = true;
+  forEachFacet(vertex, [&](uint32_t facet)
+  {
+   if (!isValid || hasVertex(facet, otherVertex))
+    return;
+   const uint32_t* v = &m_facetVertices[facet * 3];
+   uint32_t rotated[3] = { v[0], v[1], v[2] };
+   for (size_t corner = 0; corner < 3; ++corner)
+   {
+    if (v[corner] == vertex)
+    {
+     rotated[0] = v[corner]; rotated[1] = v[(corner + 1) % 3]; rotated[2] = v[(corner + 2) % 3];
+    }
+   }
+   double before[3], after[3];
+   getFacetNormal(rotated, m_x[vertex], m_y[vertex], m_z[vertex], before);
+   if (getFacetNormal(rotated, collapse.x, collapse.y, collapse.z, after) <= 0.0)
+    isValid = false;
+   else if (before[0] * after[0] + before[1] * after[1] + before[2] * after[2] < 0.2)
+    isValid = false;
+  });
+  return isValid;
+ }
+
+ void pushCollapses(uint32_t vertex, std::priority_queue<Collapse>& collapses) const
+ {
+  forEachFacet(vertex, [&](uint32_t facet)
+  {
+   const uint32_t* v = &m_facetVertices[facet * 3];
+   for (size_t corner = 0; corner < 3; ++corner)
+   {
+    Collapse collapse;
+    if (v[corner] != vertex && getCollapse(vertex, v[corner], collapse))
+     collapses.push(collapse);
+   }
+  });
+ }
+
+ // Collapses the cheapest edges of the slab until removeCount facets are removed or
+ // the error bound is reached. Collapses made stale by an earlier one are skipped.
+ void decimateSlab(const std::vector<uint32_t>& facets, size_t removeCount)
+ {
+  std::priority_queue<Collapse> collapses;
+  for (size_t k = 0; k < facets.size(); ++k)
+  {
+   const uint32_t* v = &m_facetVertices[facets[k] * 3];
+   for (size_t corner = 0; corner < 3; ++corner)
+   {
+    // An inner edge is seen once in each direction; a boundary edge only once.
+    uint32_t vertexOne = v[corner], vertexTwo = v[(corner + 1) % 3];
+    if (vertexOne > vertexTwo && getEdgeFacetCount(vertexOne, vertexTwo) > 1)
+     continue;
+    Collapse collapse;
+    if (getCollapse(vertexOne, vertexTwo, collapse))
+     collapses.push(collapse);
+   }
+  }
+
+  double maxCost = m_options.maxError * m_options.maxError;
+  size_t removedCount = 0;
+  while (removedCount < removeCount && !collapses.empty())
+  {
+   Collapse collapse = collapses.top();
+   collapses.pop();
+   if (collapse.cost > maxCost)
+    break;
+   uint32_t keep = collapse.vertexOne, remove = collapse.vertexTwo;
+   if (collapse.stampOne != m_vertexStamps[keep] || collapse.stampTwo != m_vertexStamps[remove])
+    continue;
+   if (!isLinkConditionMet(keep, remove) || !isCollapseValid(keep, remove, collapse) || !isCollapseValid(remove, keep, collapse))
+    continue;
+
+   forEachFacet(remove, [&](uint32_t facet)
+   {
+    uint32_t* v = &m_facetVertices[facet * 3];
+    if (hasVertex(facet, keep))
+    {
+     m_isFacetAlive[facet] = 0;
+     ++removedCount;
+     return;
+    }
+    for (size_t corner = 0; corner < 3; ++corner)
+    {
+     if (v[corner] == remove)
+      v[corner] = keep;
+    }
+   });
+   // Join the rings of merged vertices, so the rows of the removed vertex go to the kept one.
+   std::swap(m_nextMerged[keep], m_nextMerged[remove]);
+
+   m_x[keep] = collapse.x; m_y[keep] = collapse.y; m_z[keep] = collapse.z;
+   m_quadrics[keep] += m_quadrics[remove];
+   m_isVertexOnBoundary[keep] |= m_isVertexOnBoundary[remove];
+   ++m_vertexStamps[keep];
+   ++m_vertexStamps[remove];
+   pushCollapses(keep, collapses);
+  }
+ }
+
+ DecimationOptions m_options;
+ std::vector<double> m_x, m_y, m_z;
+ std::vector<uint32_t> m_facetVertices;
+ std::vector<uint8_t> m_isFacetAlive;
+ std::vector<uint8_t> m_isVertexLocked;
+ std::vector<uint32_t> m_vertexStamps;
+ std::vector<uint8_t> m_isVertexOnBoundary;
+ std::vector<Quadric> m_quadrics;
+ // Facets around each vertex in compressed rows, and the next vertex in the ring of
+ // the vertices merged together.
+ std::vector<uint32_t> m_facetOffsets;
+ std::vector<uint32_t> m_adjacentFacets;
+ std::vector<uint32_t> m_nextMerged;
+};
+
+// Gets the squared distance from the point to the triangle.
+double getSquaredDistanceToTriangle(const double* p, const double* a, const double* b, const double* c)
+{
+ double ab[3], ac[3], ap[3], closest[3];
+ for (size_t i = 0; i < 3; ++i)
+ {
+  ab[i] = b[i] - a[i]; ac[i] = c[i] - a[i]; ap[i] = p[i] - a[i];
+ }
+ double d1 = ab[0] * ap[0] + ab[1] * ap[1] + ab[2] * ap[2];
+ double d2 = ac[0] * ap[0] + ac[1] * ap[1] + ac[2] * ap[2];
+ double bp[3] = { p[0] - b[0], p[1] - b[1], p[2] - b[2] };
+ double d3 = ab[0] * bp[0] + ab[1] * bp[1] + ab[2] * bp[2];
+ double d4 = ac[0] * bp[0] + ac[1] * bp[1] + ac[2] * bp[2];
+ double cp[3] = { p[0] - c[0], p[1] - c[1], p[2] - c[2] };
+ double d5 = ab[0] * cp[0] + ab[1] * cp[1] + ab[2] * cp[2];
+ double d6 = ac[0] * cp[0] + ac[1] * cp[1] + ac[2] * cp[2];
+ double va = d3 * d6 - d5 * d4, vb = d5 * d2 - d1 * d6, vc = d1 * d4 - d3 * d2;
+
+ double s = 0, t = 0;
+ if (d1 <= 0 && d2 <= 0)
+  s = 0, t = 0;
+ else if (d3 >= 0 && d4 <= d3)
+  s = 1, t = 0;
+ else if (d6 >= 0 && d5 <= d6)
+  s = 0, t = 1;
+ else if (vc <= 0 && d1 >= 0 && d3 <= 0)
+  s = d1 / (d1 - d3), t = 0;
+ else if (vb <= 0 && d2 >= 0 && d6 <= 0)
+  s = 0, t = d2 / (d2 - d6);
+ else if (va <= 0 && (d4 - d3) >= 0 && (d5 - d6) >= 0)
+ {
+  t = (d4 - d3) / ((d4 - d3) + (d5 - d6));
+  s = 1 - t;
+ }
+ else
+ {
+  double denominator = 1 / (va + vb + vc);
+  s = vb * denominator, t = vc * denominator;
+ }
+
+ double squaredDistance = 0;
+ for (size_t i = 0; i < 3; ++i)
+ {
+  closest[i] = a[i] + ab[i] * s + ac[i] * t;
+  squaredDistance += (p[i] - closest[i]) * (p[i] - closest[i]);
+ }
+ return squaredDistance;
+}
+
+// Gets the largest distance from a vertex of one mesh to the surface of the other. The
+// facets of the other mesh are binned in a uniform grid searched ring by ring.
+double getMaxDistanceToMesh(const IndexedMesh& from, const IndexedMesh& to)
+{
+ size_t facetCount = to.facetCount();
+ if (facetCount == 0 || from.x.empty())
+  return 0.0;
+
+ double minimum[3] = { *std::min_element(to.x.begin(), to.x.end()), *std::min_element(to.y.begin(), to.y.end()), *std::min_element(to.z.begin(), to.z.end()) };
+ double maximum[3] = { *std::max_element(to.x.begin(), to.x.end()), *std::max_element(to.y.begin(), to.y.end()), *std::max_element(to.z.begin(), to.z.end()) };
+ // Size the cells after the average facet, growing them while there are many more cells than facets.
+ double area = 0.0;
+ for (size_t facet = 0; facet < facetCount; ++facet)
+ {
+  const uint32_t* v = &to.facetVertices[facet * 3];
+  double ax = to.x[v[1]] - to.x[v[0]], ay = to.y[v[1]] - to.y[v[0]], az = to.z[v[1]] - to.z[v[0]];
+  double bx = to.x[v[2]] - to.x[v[0]], by = to.y[v[2]] - to.y[v[0]], bz = to.z[v[2]] - to.z[v[0]];
+  area += sqrt((ay * bz - az * by) * (ay * bz - az * by) + (az * bx - ax * bz) * (az * bx - ax * bz) + (ax * by - ay * bx) * (ax * by - ay * bx)) / 2;
+ }
+ double cellSize = std::max(2 * sqrt(area / facetCount), 1.0e-9);
+ int cellCounts[3];
+ for (;;)
+ {
+  for (size_t axis = 0; axis < 3; ++axis)
+   cellCounts[axis] = std::max(1, static_cast<int>((maximum[axis] - minimum[axis]) / cellSize) + 1);
+  if (static_cast<double>(cellCounts[0]) * cellCounts[1] * cellCounts[2] <= 8.0 * facetCount + 64)
+   break;
+  cellSize *= 1.5;
+ }
+
+ auto getCell = [&](double value, size_t axis)
+ {
+  return std::min(cellCounts[axis] - 1, std::max(0, static_cast<int>((value - minimum[axis]) / cellSize)));
+ };
+ auto getCellIndex = [&](int i, int j, int k)
+ {
+  return (static_cast<size_t>(k) * cellCounts[1] + j) * cellCounts[0] + i;
+ };
+
+ // Bin the facets by their bounding box, in compressed rows.
+ size_t cellCount = static_cast<size_t>(cellCounts[0]) * cellCounts[1] * cellCounts[2];
+ std::vector<uint32_t> cellStarts(cellCount + 1, 0), cellFacets;
+ for (int pass = 0; pass < 2; ++pass)
+ {
+  std::vector<uint32_t> cellFill(cellStarts.begin(), cellStarts.end() - 1);
+  for (size_t facet = 0; facet < facetCount; ++facet)
+  {
+   const uint32_t* v = &to.facetVertices[facet * 3];
+   int low[3], high[3];
+   const std::vector<float>* coordinates[3] = { &to.x, &to.y, &to.z };
+   for (size_t axis = 0; axis < 3; ++axis)
+   {
+    const std::vector<float>& c = *coordinates[axis];
+    low[axis] = getCell(std::min(c[v[0]], std::min(c[v[1]], c[v[2]])), axis);
+    high[axis] = getCell(std::max(c[v[0]], std::max(c[v[1]], c[v[2]])), axis);
+   }
+   for (int k = low[2]; k <= high[2]; ++k)
+    for (int j = low[1]; j <= high[1]; ++j)
+     for (int i = low[0]; i <= high[0]; ++i)
+     {
+      if (pass == 0)
+       ++cellStarts[getCellIndex(i, j, k) + 1];
+      else
+       cellFacets[cellFill[getCellIndex(i, j, k)]++] = static_cast<uint32_t>(facet);
+     }
+  }
+  if (pass == 0)
+  {
+   for (size_t cell = 0; cell < cellCount; ++cell)
+    cellStarts[cell + 1] += cellStarts[cell];
+   cellFacets.resize(cellStarts[cellCount]);
+  }
+ }
+
+ size_t threadCount = getThreadCount();
+ std::vector<double> threadMaximums(threadCount, 0.0);
+ size_t pointCount = from.x.size();
+ size_t chunkSize = (pointCount + threadCount - 1) / threadCount;
+ parallelFor(threadCount, threadCount, [&](size_t begin, size_t end)
+ {
+  for (size_t thread = begin; thread < end; ++thread)
+  {
+   for (size_t point = thread * chunkSize; point < std::min(pointCount, (thread + 1) * chunkSize); ++point)
+   {
+    double p[3] = { from.x[point], from.y[point], from.z[point] };
+    int center[3] = { getCell(p[0], 0), getCell(p[1], 1), getCell(p[2], 2) };
+    double best = std::numeric_limits<double>::infinity();
+    int maxRing = std::max(cellCounts[0], std::max(cellCounts[1], cellCounts[2]));
+    for (int ring = 0; ring <= maxRing; ++ring)
+    {
+     for (int k = center[2] - ring; k <= center[2] + ring; ++k)
+      for (int j = center[1] - ring; j <= center[1] + ring; ++j)
+       for (int i = center[0] - ring; i <= center[0] + ring; ++i)
+       {
+        bool isOnRing = std::abs(i - center[0]) == ring || std::abs(j - center[1]) == ring || std::abs(k - center[2]) == ring;
+        if (!isOnRing || i < 0 || j < 0 || k < 0 || i >= cellCounts[0] || j >= cellCounts[1] || k >= cellCounts[2])
+         continue;
+        size_t cell = getCellIndex(i, j, k);
+        for (uint32_t n = cellStarts[cell]; n < cellStarts[cell + 1]; ++n)
+        {
+         const uint32_t* v = &to.facetVertices[cellFacets[n] * 3];
+         double a[3] = { to.x[v[0]], to.y[v[0]], to.z[v[0]] };
+         double b[3] = { to.x[v[1]], to.y[v[1]], to.z[v[1]] };
+         double c[3] = { to.x[v[2]], to.y[v[2]], to.z[v[2]] };
+         best = std::min(best, getSquaredDistanceToTriangle(p, a, b, c));
+        }
+       }
+     // Cells beyond this ring are at least ring cells away from the point.
+     double ringDistance = ring * cellSize;
+     if (best <= ringDistance * ringDistance)
+      break;
+    }
+    threadMaximums[thread] = std::max(threadMaximums[thread], best);
+   }
+  }
+ });
+ return sqrt(*std::max_element(threadMaximums.begin(), threadMaximums.end()));
+}
+
+// Decimates the mesh and measures the symmetric Hausdorff distance to the input.
+void decimateMesh(const IndexedMesh& input, const DecimationOptions& options, IndexedMesh& output, DecimationReport& report)
+{
+ std::chrono::steady_clock::time_point startTime = std::chrono::steady_clock::now();
+ MeshDecimator decimator(input, options);
+ decimator.run(output);
+ report.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+ report.inputFacetCount = input.facetCount();
+ report.outputFacetCount = output.facetCount();
+ report.hausdorffDistance = std::max(getMaxDistanceToMesh(input, output), getMaxDistanceToMesh(output, input));
+}
+
 extern "C" XI_EXPORT bool run(const char* context)
 {
  app = Application::get();
@@ -80,9 +1296,53 @@ extern "C" XI_EXPORT bool run(const char* context)
 
  std::string stlFilePath = getDllPath() + "/" + "APIMeshFacetColors.stl";
 
+ // Read, weld and validate the mesh natively, then time the plain import of the same file
+ std::chrono::steady_clock::time_point readStart = std::chrono::steady_clock::now();
+ StlMesh stlMesh;
+ if (!readStlFile(stlFilePath, stlMesh))
+  return false;
+ StlWeldResult weldResult;
+ weldAndValidateStlMesh(stlMesh, 1.0e-6f, weldResult);
+ double readSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - readStart).count();
+
+ std::chrono::steady_clock::time_point importStart = std::chrono::steady_clock::now();
  Ptr<MeshBodyList> meshBodyList = meshBodies->add(stlFilePath, MeshUnits::InchMeshUnit);
  if (!meshBodyList)
   return false;
+ double importSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - importStart).count();
+
+ size_t coloredFacetCount = stlMesh.facetCount() - std::count(stlMesh.colors.begin(), stlMesh.colors.end(), 0u);
+ double megabytes = (stlMesh.isBinary ? 84.0 + 50.0 * stlMesh.facetCount() : 0.0) / (1024 * 1024);
+ std::stringstream readReport;
+ readReport << (stlMesh.isBinary ? "Binary" : "ASCII") << " STL: " << stlMesh.facetCount() << " facets, " << coloredFacetCount << " colored, "
+  << weldResult.vertexX.size() << " welded vertices, " << weldResult.degenerateCount << " degenerate and " << weldResult.duplicateCount << " duplicate facets.\n"
+  << "Native read, weld and validation: " << readSeconds << " s";
+ if (stlMesh.isBinary && readSeconds > 0)
+  readReport << " (" << megabytes / readSeconds << " MB/s)";
+ readReport << "\nMeshBodies::add: " << importSeconds << " s";
+ ui->messageBox(readReport.str());
+
+ // Decimate the mesh to half of its facets and import the result from a temporary STL file
+ IndexedMesh weldedMesh;
+ getIndexedMesh(weldResult, weldedMesh);
+ DecimationOptions decimationOptions;
+ decimationOptions.targetFacetCount = weldedMesh.facetCount() / 2;
+ IndexedMesh decimatedMesh;
+ DecimationReport decimationReport;
+ decimateMesh(weldedMesh, decimationOptions, decimatedMesh, decimationReport);
+
+ std::string decimatedFilePath = getDllPath() + "/" + "APIMeshFacetColors.decimated.stl";
+ if (!writeBinaryStl(decimatedFilePath, decimatedMesh))
+  return false;
+ Ptr<MeshBodyList> decimatedBodyList = meshBodies->add(decimatedFilePath, MeshUnits::InchMeshUnit);
+ std::remove(decimatedFilePath.c_str());
+ if (!decimatedBodyList)
+  return false;
+
+ std::stringstream decimationMessage;
+ decimationMessage << "Decimated " << decimationReport.inputFacetCount << " facets to " << decimationReport.outputFacetCount << " in "
+  << decimationReport.seconds << " s.\nHausdorff distance: " << decimationReport.hausdorffDistance << " in";
+ ui->messageBox(decimationMessage.str());
 
  Ptr<MeshBody> stlMeshBody = meshBodyList->item(0);
  if (!stlMeshBody)
@@ -23,6 +23,12 @@
 #include <Fusion/Graphics/CustomGraphicsGroups.h>
 #include <Fusion/Graphics/CustomGraphicsGroup.h>
 
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <vector>
+
 
 using namespace adsk::core;
 using namespace adsk::fusion;
@@ -32,6 +38,92 @@ Ptr<UserInterface> ui;
 
 std::string getDllPath();
 
+// Exports a large number of temporary bodies while keeping only one batch in memory.
+// Bodies are accepted one by one; every time the batch is full it is written with
+// TemporaryBRepManager::exportToFile and the bodies are released. exportToFile always
+// writes a complete file, so each batch goes to its own numbered part file and a
+// manifest listing all the part files is written when the stream is closed.
+class TemporaryBodyExportStream
+{
+public:
+ TemporaryBodyExportStream(const std::string& basePath, const std::string& extension, size_t batchSize)
+  : m_basePath(basePath), m_extension(extension), m_batchSize(batchSize > 0 ? batchSize : 1)
+ {
+  m_batch.reserve(m_batchSize);
+ }
+
+ // Adds a body to the current batch, writing the batch if it is full.
+ bool add(const Ptr<BRepBody>& body)
+ {
+  if (!body)
+   return false;
+
+  m_batch.push_back(body);
+  if (m_batch.size() < m_batchSize)
+   return true;
+
+  return flush();
+ }
+
+ // Writes the remaining bodies and the manifest of the part files.
+ bool close()
+ {
+  if (!flush())
+   return false;
+
+  std::ofstream manifest(m_basePath + ".manifest", std::ios::trunc);
+  if (!manifest)
+   return false;
+  for (const std::string& file : m_files)
+   manifest << file << "\n";
+  return manifest.good();
+ }
+
+ size_t bodyCount() const { return m_bodyCount; }
+ const std::vector<std::string>& files() const { return m_files; }
+ double exportSeconds() const { return m_exportSeconds; }
+ // Only the time spent in exportToFile is counted, not the time the caller takes to
+ // create the bodies.
+ double bodiesPerSecond() const { return m_exportSeconds > 0.0 ? m_bodyCount / m_exportSeconds : 0.0; }
+
+private:
+ bool flush()
+ {
+  if (m_batch.empty())
+   return true;
+
+  Ptr<TemporaryBRepManager> tempBRepMgr = TemporaryBRepManager::get();
+  if (!tempBRepMgr)
+   return false;
+
+  std::stringstream ss;
+  ss << m_basePath << "_" << std::setw(4) << std::setfill('0') << m_files.size() << "." << m_extension;
+  std::string filePath = ss.str();
+
+  std::chrono::steady_clock::time_point startTime = std::chrono::steady_clock::now();
+  bool isSuccess = tempBRepMgr->exportToFile(m_batch, filePath);
+  std::chrono::duration<double> elapsedSeconds = std::chrono::steady_clock::now() - startTime;
+  m_exportSeconds += elapsedSeconds.count();
+  if (!isSuccess)
+   return false;
+
+  m_files.push_back(filePath);
+  m_bodyCount += m_batch.size();
+
+  // Release the written bodies, the capacity is kept for the next batch.
+  m_batch.clear();
+  return true;
+ }
+
+ std::string m_basePath;
+ std::string m_extension;
+ size_t m_batchSize;
+ std::vector< Ptr<BRepBody> > m_batch;
+ std::vector<std::string> m_files;
+ size_t m_bodyCount = 0;
+ double m_exportSeconds = 0.0;
+};
+
 Ptr<BRepBody> CreateBox()
 {
  //Get TemporaryBRepManager
@@ -470,6 +562,33 @@ extern "C" XI_EXPORT bool run(const char* context)
  if (!newBodies)
   return false;
 
+ // Stream a lattice of temporary spheres to files, 100 bodies at a time.
+ TemporaryBodyExportStream exportStream(dllPath + "/" + "latticeFile", "smt", 100);
+ for (int i = 0; i < 10; ++i)
+ {
+  for (int j = 0; j < 10; ++j)
+  {
+   for (int k = 0; k < 10; ++k)
+   {
+    Ptr<Point3D> latticeCenter = Point3D::create(i * 2.0, j * 2.0, k * 2.0);
+    Ptr<BRepBody> latticeSphere = tempBRepMgr->createSphere(latticeCenter, 0.5);
+    if (!latticeSphere)
+     return false;
+
+    if (!exportStream.add(latticeSphere))
+     return false;
+   }
+  }
+ }
+ if (!exportStream.close())
+  return false;
+
+ std::stringstream ss;
+ ss << "Exported " << exportStream.bodyCount() << " bodies to " << exportStream.files().size() << " files\n";
+ ss << "Export time: " << exportStream.exportSeconds() << " s\n";
+ ss << "Throughput: " << exportStream.bodiesPerSecond() << " bodies/s";
+ ui->messageBox(ss.str(), "Streaming Export");
+
  return true;
 }
 